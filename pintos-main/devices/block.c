@@ -1,7 +1,10 @@
 #include "devices/block.h"
 
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
 
 #include <list.h>
 #include <stdio.h>
@@ -17,9 +20,26 @@ struct block {
 
 	const struct block_operations* ops; /* Driver operations. */
 	void* aux;									/* Extra data owned by driver. */
+	struct block_queue* queue;				/* Request queue, or null. */
 
-	unsigned long long read_cnt;	/* Number of sectors read. */
-	unsigned long long write_cnt; /* Number of sectors written. */
+	struct block_stats stats; /* I/O statistics. */
+};
+
+/* Most sectors that merging adjacent requests may add up to. */
+#define QUEUE_MERGE_MAX 64
+
+/* A block device's request queue, served by a kernel thread of
+	its own.  The thread takes requests in C-LOOK elevator order:
+	it keeps moving toward higher sectors while there are requests
+	ahead, then returns to the lowest.  Requests for adjacent
+	sectors in the same direction are merged into one driver
+	call. */
+struct block_queue {
+	struct list requests;		  /* Pending requests, sorted by sector. */
+	struct lock lock;				  /* Protects REQUESTS and HEAD. */
+	struct condition nonempty;	  /* Signaled when a request arrives. */
+	block_sector_t head;			  /* Sector after the last one dispatched. */
+	uint8_t* bounce;				  /* Room for QUEUE_MERGE_MAX sectors. */
 };
 
 /* List of all block devices. */
@@ -29,6 +49,8 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block* block_by_role[BLOCK_ROLE_CNT];
 
 static struct block* list_elem_to_block(struct list_elem*);
+static void transfer(struct block*, bool write, block_sector_t, size_t cnt, void*);
+static void queue_thread(void* block_);
 
 /* Returns a human-readable name for the given block device
 	TYPE. */
@@ -108,15 +130,34 @@ static void check_sector(struct block* block, block_sector_t sector)
 	}
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+	within BLOCK.  Panics if not. */
+static void check_sectors(struct block* block, block_sector_t sector, size_t cnt)
+{
+	check_sector(block, sector);
+	if (cnt > block->size - sector)
+		check_sector(block, block->size);
+}
+
+/* Submits a request to transfer CNT sectors starting at SECTOR
+	between BLOCK and BUFFER and waits for it to complete. */
+static void request_and_wait(
+	 struct block* block, bool write, block_sector_t sector, size_t cnt, void* buffer)
+{
+	struct block_request r;
+
+	block_request_init(&r, write, sector, cnt, buffer, NULL, NULL);
+	block_submit(block, &r);
+	block_wait(&r);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
 	have room for BLOCK_SECTOR_SIZE bytes.
 	Internally synchronizes accesses to block devices, so external
 	per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer)
 {
-	check_sector(block, sector);
-	block->ops->read(block->aux, sector, buffer);
-	block->read_cnt++;
+	request_and_wait(block, false, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -126,10 +167,168 @@ void block_read(struct block* block, block_sector_t sector, void* buffer)
 	per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer)
 {
-	check_sector(block, sector);
-	ASSERT(block->type != BLOCK_FOREIGN);
-	block->ops->write(block->aux, sector, buffer);
-	block->write_cnt++;
+	request_and_wait(block, true, sector, 1, (void*) buffer);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+	BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+	Drivers that support it move all of the sectors with a single
+	command.
+	Internally synchronizes accesses to block devices, so external
+	per-block device locking is unneeded. */
+void block_read_multiple(struct block* block, block_sector_t sector, size_t cnt, void* buffer)
+{
+	if (cnt > 0)
+		request_and_wait(block, false, sector, cnt, buffer);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+	BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+	Returns after the block device has acknowledged receiving all
+	of the data.  Drivers that support it move all of the sectors
+	with a single command.
+	Internally synchronizes accesses to block devices, so external
+	per-block device locking is unneeded. */
+void block_write_multiple(
+	 struct block* block, block_sector_t sector, size_t cnt, const void* buffer)
+{
+	if (cnt > 0)
+		request_and_wait(block, true, sector, cnt, (void*) buffer);
+}
+
+/* Initializes R as a request to transfer CNT sectors starting at
+	SECTOR between a block device and BUFFER, writing to the device
+	if WRITE is true and reading from it otherwise.  On completion,
+	DONE will be called with R and AUX if DONE is non-null. */
+void block_request_init(
+	 struct block_request* r,
+	 bool write,
+	 block_sector_t sector,
+	 size_t cnt,
+	 void* buffer,
+	 block_done_func* done,
+	 void* aux)
+{
+	ASSERT(cnt > 0);
+
+	r->write = write;
+	r->sector = sector;
+	r->cnt = cnt;
+	r->buffer = buffer;
+	r->done = done;
+	r->aux = aux;
+	sema_init(&r->completion, 0);
+}
+
+/* Returns the histogram bucket for VALUE among CNT log-scale
+	buckets: floor(log2(VALUE)), but at most CNT - 1, and 0 for
+	VALUE of 0. */
+static size_t log2_bucket(uint64_t value, size_t cnt)
+{
+	size_t bucket = 0;
+
+	while (value > 1 && bucket < cnt - 1) {
+		value >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/* Accounts for request R being submitted to BLOCK.  Interrupts
+	are turned off briefly, so that statistics can be updated from
+	any thread without a lock. */
+static void stats_submit(struct block* block, struct block_request* r)
+{
+	struct block_stats* s = &block->stats;
+	enum intr_level old_level;
+
+	r->block = block;
+	r->start = timer_usecs();
+
+	old_level = intr_disable();
+	if (r->write) {
+		s->write_bytes += (unsigned long long) r->cnt * BLOCK_SECTOR_SIZE;
+		s->write_requests++;
+	}
+	else {
+		s->read_bytes += (unsigned long long) r->cnt * BLOCK_SECTOR_SIZE;
+		s->read_requests++;
+	}
+	s->size_hist[log2_bucket(r->cnt, BLOCK_STATS_SIZE_CNT)]++;
+	s->in_flight++;
+	if (s->in_flight > s->max_in_flight)
+		s->max_in_flight = s->in_flight;
+	s->depth_total += s->in_flight;
+	intr_set_level(old_level);
+}
+
+/* Accounts for the completion of request R. */
+static void stats_complete(struct block_request* r)
+{
+	struct block_stats* s = &r->block->stats;
+	int64_t latency = timer_usecs() - r->start;
+	enum intr_level old_level;
+
+	if (latency < 0)
+		latency = 0;
+
+	old_level = intr_disable();
+	s->in_flight--;
+	s->latency_total += latency;
+	s->latency_hist[log2_bucket(latency, BLOCK_STATS_LATENCY_CNT)]++;
+	intr_set_level(old_level);
+}
+
+/* Marks request R complete.  Must be called from a kernel
+	thread, not an interrupt handler, because R's completion
+	function may sleep. */
+void block_complete(struct block_request* r)
+{
+	stats_complete(r);
+	if (r->done != NULL)
+		r->done(r, r->aux);
+	sema_up(&r->completion);
+}
+
+/* Returns true if request A's first sector precedes request B's. */
+static bool request_less(const struct list_elem* a, const struct list_elem* b, void* aux UNUSED)
+{
+	return list_entry(a, struct block_request, elem)->sector
+		 < list_entry(b, struct block_request, elem)->sector;
+}
+
+/* Submits request R to BLOCK and returns without waiting for it
+	to complete, unless BLOCK has neither a request queue nor a
+	SUBMIT operation, in which case R is carried out before
+	returning. */
+void block_submit(struct block* block, struct block_request* r)
+{
+	check_sectors(block, r->sector, r->cnt);
+	ASSERT(!r->write || block->type != BLOCK_FOREIGN);
+
+	stats_submit(block, r);
+
+	if (block->ops->submit != NULL) {
+		block->ops->submit(block->aux, r);
+		return;
+	}
+	if (block->queue == NULL) {
+		transfer(block, r->write, r->sector, r->cnt, r->buffer);
+		block_complete(r);
+		return;
+	}
+
+	lock_acquire(&block->queue->lock);
+	list_insert_ordered(&block->queue->requests, &r->elem, request_less, NULL);
+	cond_signal(&block->queue->nonempty, &block->queue->lock);
+	lock_release(&block->queue->lock);
+}
+
+/* Waits for request R, which must have been submitted, to
+	complete. */
+void block_wait(struct block_request* r)
+{
+	sema_down(&r->completion);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -150,21 +349,64 @@ enum block_type block_type(struct block* block)
 	return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Copies BLOCK's I/O statistics into *STATS. */
+void block_get_stats(struct block* block, struct block_stats* stats)
+{
+	enum intr_level old_level = intr_disable();
+	*stats = block->stats;
+	intr_set_level(old_level);
+
+	strlcpy(stats->name, block->name, sizeof stats->name);
+	strlcpy(stats->type, block_type_name(block->type), sizeof stats->type);
+}
+
+/* Prints TOTAL / CNT with one decimal place, or 0 if CNT is 0. */
+static void print_mean(unsigned long long total, unsigned long long cnt)
+{
+	unsigned long long tenths = cnt > 0 ? (total * 10 + cnt / 2) / cnt : 0;
+	printf("%llu.%llu", tenths / 10, tenths % 10);
+}
+
+/* Prints statistics for each block device used for a Pintos
+	role: sectors transferred, then request sizes and queue depth,
+	then the latency histogram, omitting empty buckets. */
 void block_print_stats(void)
 {
 	int i;
 
 	for (i = 0; i < BLOCK_ROLE_CNT; i++) {
 		struct block* block = block_by_role[i];
-		if (block != NULL) {
-			printf(
-				 "%s (%s): %llu reads, %llu writes\n",
-				 block->name,
-				 block_type_name(block->type),
-				 block->read_cnt,
-				 block->write_cnt);
-		}
+		struct block_stats s;
+		unsigned long long requests;
+		size_t b;
+
+		if (block == NULL)
+			continue;
+		block_get_stats(block, &s);
+		requests = s.read_requests + s.write_requests;
+
+		printf(
+			 "%s (%s): %llu reads, %llu writes\n",
+			 s.name,
+			 s.type,
+			 s.read_bytes / BLOCK_SECTOR_SIZE,
+			 s.write_bytes / BLOCK_SECTOR_SIZE);
+		if (requests == 0)
+			continue;
+
+		printf("  %llu read and %llu write requests, mean size ", s.read_requests, s.write_requests);
+		print_mean((s.read_bytes + s.write_bytes) / BLOCK_SECTOR_SIZE, requests);
+		printf(" sectors, queue depth mean ");
+		print_mean(s.depth_total, requests);
+		printf(" max %u\n", s.max_in_flight);
+
+		printf("  latency (us): mean ");
+		print_mean(s.latency_total, requests - s.in_flight);
+		printf(",");
+		for (b = 0; b < BLOCK_STATS_LATENCY_CNT; b++)
+			if (s.latency_hist[b] != 0)
+				printf(" %d+:%u", b > 0 ? 1 << b : 0, s.latency_hist[b]);
+		printf("\n");
 	}
 }
 
@@ -191,8 +433,8 @@ struct block* block_register(
 	block->size = size;
 	block->ops = ops;
 	block->aux = aux;
-	block->read_cnt = 0;
-	block->write_cnt = 0;
+	block->queue = NULL;
+	memset(&block->stats, 0, sizeof block->stats);
 
 	printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
 	print_human_readable_size((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -204,6 +446,162 @@ struct block* block_register(
 	return block;
 }
 
+/* Gives BLOCK a request queue and a kernel thread to serve it, so
+	that requests are carried out in elevator order and adjacent
+	ones are merged.  Drivers for devices with a seek cost should
+	call this right after block_register(). */
+void block_enable_queue(struct block* block)
+{
+	struct block_queue* q;
+	char name[16];
+
+	ASSERT(block->queue == NULL);
+	ASSERT(block->ops->submit == NULL);
+
+	q = malloc(sizeof *q);
+	if (q == NULL || (q->bounce = malloc(QUEUE_MERGE_MAX * BLOCK_SECTOR_SIZE)) == NULL)
+		PANIC("Failed to allocate memory for block device queue");
+	list_init(&q->requests);
+	lock_init(&q->lock);
+	cond_init(&q->nonempty);
+	q->head = 0;
+	block->queue = q;
+
+	snprintf(name, sizeof name, "%s-io", block->name);
+	thread_create_daemon(name, PRI_DEFAULT, queue_thread, block);
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+	BUFFER by calling BLOCK's driver, writing to BLOCK if WRITE is
+	true and reading from it otherwise. */
+static void transfer(
+	 struct block* block, bool write, block_sector_t sector, size_t cnt, void* buffer_)
+{
+	const struct block_operations* ops = block->ops;
+	uint8_t* buffer = buffer_;
+	size_t i;
+
+	if (write && ops->write_multiple != NULL)
+		ops->write_multiple(block->aux, sector, cnt, buffer);
+	else if (!write && ops->read_multiple != NULL)
+		ops->read_multiple(block->aux, sector, cnt, buffer);
+	else
+		for (i = 0; i < cnt; i++) {
+			if (write)
+				ops->write(block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+			else
+				ops->read(block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+		}
+}
+
+/* Moves the next requests to serve from Q to BATCH: the first
+	request at or after Q's head, or the lowest request if there is
+	none, plus the requests that continue it on disk in the same
+	direction.  Returns the total number of sectors in BATCH.  Q's
+	lock must be held and Q must not be empty. */
+static size_t next_batch(struct block_queue* q, struct list* batch)
+{
+	struct block_request* first = NULL;
+	struct list_elem* e;
+	block_sector_t end;
+	size_t cnt;
+
+	ASSERT(!list_empty(&q->requests));
+
+	for (e = list_begin(&q->requests); e != list_end(&q->requests); e = list_next(e))
+		if (list_entry(e, struct block_request, elem)->sector >= q->head) {
+			first = list_entry(e, struct block_request, elem);
+			break;
+		}
+	if (first == NULL)
+		first = list_entry(list_begin(&q->requests), struct block_request, elem);
+
+	e = list_remove(&first->elem);
+	list_push_back(batch, &first->elem);
+	end = first->sector + first->cnt;
+	cnt = first->cnt;
+	while (e != list_end(&q->requests)) {
+		struct block_request* r = list_entry(e, struct block_request, elem);
+		if (r->write != first->write || r->sector != end || cnt + r->cnt > QUEUE_MERGE_MAX)
+			break;
+
+		e = list_remove(&r->elem);
+		list_push_back(batch, &r->elem);
+		end += r->cnt;
+		cnt += r->cnt;
+	}
+	q->head = end;
+	return cnt;
+}
+
+/* Carries out BATCH, a list of CNT sectors' worth of requests
+	for adjacent sectors in the same direction, with one driver
+	call, and completes them.  Goes through BLOCK's bounce buffer
+	unless the requests' buffers are adjacent in memory too. */
+static void dispatch(struct block* block, struct list* batch, size_t cnt)
+{
+	struct block_request* first = list_entry(list_front(batch), struct block_request, elem);
+	uint8_t* bounce = block->queue->bounce;
+	uint8_t* next = first->buffer;
+	bool contiguous = true;
+	struct list_elem* e;
+
+	for (e = list_begin(batch); e != list_end(batch); e = list_next(e)) {
+		struct block_request* r = list_entry(e, struct block_request, elem);
+		if (r->buffer != next) {
+			contiguous = false;
+			break;
+		}
+		next += r->cnt * BLOCK_SECTOR_SIZE;
+	}
+
+	if (contiguous)
+		transfer(block, first->write, first->sector, cnt, first->buffer);
+	else {
+		size_t ofs;
+
+		if (first->write)
+			for (e = list_begin(batch), ofs = 0; e != list_end(batch); e = list_next(e)) {
+				struct block_request* r = list_entry(e, struct block_request, elem);
+				memcpy(bounce + ofs, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+				ofs += r->cnt * BLOCK_SECTOR_SIZE;
+			}
+		transfer(block, first->write, first->sector, cnt, bounce);
+		if (!first->write)
+			for (e = list_begin(batch), ofs = 0; e != list_end(batch); e = list_next(e)) {
+				struct block_request* r = list_entry(e, struct block_request, elem);
+				memcpy(r->buffer, bounce + ofs, r->cnt * BLOCK_SECTOR_SIZE);
+				ofs += r->cnt * BLOCK_SECTOR_SIZE;
+			}
+	}
+
+	/* A request may be freed as soon as it completes, so remove it
+		from BATCH first. */
+	while (!list_empty(batch))
+		block_complete(list_entry(list_pop_front(batch), struct block_request, elem));
+}
+
+/* Request queue thread for block device BLOCK_. */
+static void queue_thread(void* block_)
+{
+	struct block* block = block_;
+	struct block_queue* q = block->queue;
+
+	for (;;) {
+		struct list batch;
+		size_t cnt;
+
+		list_init(&batch);
+		lock_acquire(&q->lock);
+		while (list_empty(&q->requests))
+			cond_wait(&q->nonempty, &q->lock);
+		cnt = next_batch(q, &batch);
+		lock_release(&q->lock);
+
+		dispatch(block, &batch, cnt);
+	}
+}
+
 /* Returns the block device corresponding to LIST_ELEM, or a null
 	pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block* list_elem_to_block(struct list_elem* list_elem)
@@ -1,7 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include "threads/synch.h"
+
+#include <block-stats.h>
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 /* Size of a block device sector in bytes.
@@ -52,17 +57,68 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_read_multiple(struct block*, block_sector_t, size_t cnt, void*);
+void block_write_multiple(struct block*, block_sector_t, size_t cnt, const void*);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
+/* Asynchronous requests.
+
+	A request transfers CNT contiguous sectors starting at SECTOR
+	between the device and BUFFER.  Once submitted, it belongs to
+	the block layer until it completes, at which point DONE (if
+	non-null) is called with AUX from a kernel thread and then
+	block_wait() returns.  Requests that are in flight at the same
+	time may complete in any order. */
+struct block_request;
+typedef void block_done_func(struct block_request*, void* aux);
+
+struct block_request {
+	struct list_elem elem;		  /* Element in device's queue. */
+	bool write;						  /* Write to device, or read from it? */
+	block_sector_t sector;		  /* First sector. */
+	size_t cnt;						  /* Number of sectors. */
+	void* buffer;					  /* CNT * BLOCK_SECTOR_SIZE bytes. */
+	block_done_func* done;		  /* Called on completion, if non-null. */
+	void* aux;						  /* Passed to DONE. */
+	struct semaphore completion; /* Up'd on completion. */
+	struct block* block;			  /* Device submitted to. */
+	int64_t start;					  /* Submission time, from timer_usecs(). */
+};
+
+void block_request_init(
+	 struct block_request*,
+	 bool write,
+	 block_sector_t,
+	 size_t cnt,
+	 void* buffer,
+	 block_done_func*,
+	 void* aux);
+void block_submit(struct block*, struct block_request*);
+void block_wait(struct block_request*);
+
 /* Statistics. */
+void block_get_stats(struct block*, struct block_stats*);
 void block_print_stats(void);
 
-/* Lower-level interface to block device drivers. */
+/* Lower-level interface to block device drivers.
+	READ_MULTIPLE and WRITE_MULTIPLE transfer CNT contiguous
+	sectors at once.  They may be null, in which case the block
+	layer calls READ or WRITE once per sector instead.
+
+	A driver that can keep many requests in flight supplies SUBMIT
+	instead.  The block layer then hands every request straight to
+	SUBMIT, bypassing any queue, and the driver calls
+	block_complete() from a kernel thread when the request is
+	done.  READ, WRITE, READ_MULTIPLE, and WRITE_MULTIPLE are not
+	used for such a device and may be null. */
 
 struct block_operations {
 	void (*read)(void* aux, block_sector_t, void* buffer);
 	void (*write)(void* aux, block_sector_t, const void* buffer);
+	void (*read_multiple)(void* aux, block_sector_t, size_t cnt, void* buffer);
+	void (*write_multiple)(void* aux, block_sector_t, size_t cnt, const void* buffer);
+	void (*submit)(void* aux, struct block_request*);
 };
 
 struct block* block_register(
@@ -72,5 +128,7 @@ struct block* block_register(
 	 block_sector_t size,
 	 const struct block_operations*,
 	 void* aux);
+void block_enable_queue(struct block*);
+void block_complete(struct block_request*);
 
 #endif /* devices/block.h */
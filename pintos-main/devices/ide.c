@@ -2,15 +2,18 @@
 
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 #include <ctype.h>
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 /* The code in this file is an interface to an ATA (IDE)
 	controller.  It attempts to comply to [ATA-3]. */
@@ -26,6 +29,12 @@
 #define reg_status(CHANNEL)  ((CHANNEL)->reg_base + 7) /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status(CHANNEL)		 /* Command (w/o). */
 
+/* Bus master IDE port addresses, present if the controller
+	supports DMA. */
+#define bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define bm_status(CHANNEL)	 ((CHANNEL)->bm_base + 2) /* Status. */
+#define bm_prdt(CHANNEL)	 ((CHANNEL)->bm_base + 4) /* PRD table address. */
+
 /* ATA control block port addresses.
 	(If we supported non-legacy ATA controllers this would not be
 	flexible enough, but it's fine for what we do.) */
@@ -36,6 +45,15 @@
 #define STA_BSY  0x80 /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ  0x08 /* Data Request. */
+#define STA_ERR  0x01 /* Error. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ	0x08 /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR  0x02 /* Transfer failed.  Write 1 to clear. */
+#define BM_STA_INTR 0x04 /* Disk interrupted.  Write 1 to clear. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -51,6 +69,14 @@
 #define CMD_IDENTIFY_DEVICE	 0xec /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY	 0x20 /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE		 0xc4 /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE		 0xc5 /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE	 0xc6 /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA				 0xc8 /* READ DMA. */
+#define CMD_WRITE_DMA			 0xca /* WRITE DMA. */
+
+/* Most sectors a single READ or WRITE command can transfer. */
+#define MAX_SECTORS_PER_COMMAND 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -58,6 +84,9 @@ struct ata_disk {
 	struct channel* channel; /* Channel that disk is attached to. */
 	int dev_no;					 /* Device 0 or 1 for master or slave. */
 	bool is_ata;				 /* Is device an ATA disk? */
+	size_t multiple;			 /* Sectors per interrupt with READ/WRITE
+										 MULTIPLE, or 1 if unsupported. */
+	bool dma;					 /* Transfer data with bus master DMA? */
 };
 
 /* An ATA channel (aka controller).
@@ -66,6 +95,7 @@ struct channel {
 	char name[8];		 /* Name, e.g. "ide0". */
 	uint16_t reg_base; /* Base I/O port. */
 	uint8_t irq;		 /* Interrupt in use. */
+	uint16_t bm_base;	 /* Bus master I/O port, or 0 if no DMA. */
 
 	struct lock lock;						 /* Must acquire to access the controller. */
 	bool expecting_interrupt;			 /* True if an interrupt is expected, false if
@@ -79,16 +109,41 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* A physical region descriptor, which tells the bus master where
+	to put or get part of a DMA transfer.  A region must not cross
+	a 64 kB boundary. */
+struct prd {
+	uint32_t addr;	  /* Physical address. */
+	uint16_t size;	  /* Size in bytes, with 0 meaning 64 kB. */
+	uint16_t flags; /* PRD_EOT in the last descriptor. */
+};
+#define PRD_EOT 0x8000
+
+/* One table of physical region descriptors per channel.  Splitting
+	a transfer at page boundaries takes one descriptor per page,
+	plus one if the buffer is not page aligned.  The alignment
+	keeps each table from crossing a 64 kB boundary. */
+#define PRD_CNT 64
+static struct prd prd_tables[CHANNEL_CNT][PRD_CNT]
+	 __attribute__((aligned(PRD_CNT * sizeof(struct prd))));
+
 static struct block_operations ide_operations;
 
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
 
-static void select_sector(struct ata_disk*, block_sector_t);
-static void issue_pio_command(struct channel*, uint8_t command);
-static void input_sector(struct channel*, void*);
-static void output_sector(struct channel*, const void*);
+static void set_multiple_mode(struct ata_disk*, size_t max);
+static uint16_t find_bus_master(void);
+
+static void pio_read(struct ata_disk*, block_sector_t, size_t cnt, void*);
+static void pio_write(struct ata_disk*, block_sector_t, size_t cnt, const void*);
+static bool dma_transfer(struct ata_disk*, block_sector_t, size_t cnt, void*, bool write);
+
+static void select_sector(struct ata_disk*, block_sector_t, size_t cnt);
+static void issue_command(struct channel*, uint8_t command);
+static void input_sectors(struct channel*, void*, size_t cnt);
+static void output_sectors(struct channel*, const void*, size_t cnt);
 
 static void wait_until_idle(const struct ata_disk*);
 static bool wait_while_busy(const struct ata_disk*);
@@ -100,6 +155,7 @@ static void interrupt_handler(struct intr_frame*);
 /* Initialize the disk subsystem and detect disks. */
 void ide_init(void)
 {
+	uint16_t bm_base = find_bus_master();
 	size_t chan_no;
 
 	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -120,6 +176,7 @@ void ide_init(void)
 			default:
 				NOT_REACHED();
 		}
+		c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
 		lock_init(&c->lock);
 		c->expecting_interrupt = false;
 		sema_init(&c->completion_wait, 0);
@@ -131,6 +188,8 @@ void ide_init(void)
 			d->channel = c;
 			d->dev_no = dev_no;
 			d->is_ata = false;
+			d->multiple = 1;
+			d->dma = false;
 		}
 
 		/* Register interrupt handler. */
@@ -150,6 +209,30 @@ void ide_init(void)
 	}
 }
 
+/* Looks for a PCI IDE controller that can act as a bus master
+	and, if there is one, enables bus mastering and returns the
+	base of its bus master I/O ports.  Returns 0 if there is none,
+	in which case all transfers use PIO. */
+static uint16_t find_bus_master(void)
+{
+	struct pci_device dev;
+	uint32_t bar;
+
+	/* Bit 7 of the programming interface means bus master
+		capable. */
+	if (!pci_find_class(0x01, 0x01, &dev) || !(dev.prog_if & 0x80))
+		return 0;
+	bar = pci_read_config(&dev, PCI_REG_BAR(4));
+	if (!(bar & PCI_BAR_IO) || (bar & PCI_BAR_IO_MASK) == 0)
+		return 0;
+
+	pci_write_config(
+		 &dev,
+		 PCI_REG_COMMAND,
+		 pci_read_config(&dev, PCI_REG_COMMAND) | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+	return bar & PCI_BAR_IO_MASK;
+}
+
 /* Disk detection and identification. */
 
 static char* descramble_ata_string(char*, int size);
@@ -256,13 +339,13 @@ static void identify_ata_device(struct ata_disk* d)
 		indicating the device's response is ready, and read the data
 		into our buffer. */
 	select_device_wait(d);
-	issue_pio_command(c, CMD_IDENTIFY_DEVICE);
+	issue_command(c, CMD_IDENTIFY_DEVICE);
 	sema_down(&c->completion_wait);
 	if (!wait_while_busy(d)) {
 		d->is_ata = false;
 		return;
 	}
-	input_sector(c, id);
+	input_sectors(c, id, 1);
 
 	/* Calculate capacity.
 		Read model name and serial number. */
@@ -285,8 +368,20 @@ static void identify_ata_device(struct ata_disk* d)
 		return;
 	}
 
+	/* Have the disk interrupt once per group of sectors, rather
+		than once per sector, if it can.  The low byte of word 47 is
+		the largest group it supports. */
+	set_multiple_mode(d, (uint8_t) id[47 * 2]);
+
+	/* Use DMA if both the controller and the disk support it.  Bit
+		8 of word 49 says the disk does. */
+	d->dma = c->bm_base != 0 && (*(uint16_t*) &id[49 * 2] & 0x100) != 0;
+	if (d->dma)
+		strlcat(extra_info, ", DMA", sizeof extra_info);
+
 	/* Register. */
 	block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &ide_operations, d);
+	block_enable_queue(block);
 	partition_scan(block);
 }
 
@@ -315,56 +410,230 @@ static char* descramble_ata_string(char* string, int size)
 	return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-	room for BLOCK_SECTOR_SIZE bytes.
+/* Tries to put disk D in multiple mode with up to MAX sectors
+	per interrupt, and records the result in D's multiple
+	member. */
+static void set_multiple_mode(struct ata_disk* d, size_t max)
+{
+	struct channel* c = d->channel;
+
+	/* The group size must be a power of 2. */
+	while (max & (max - 1))
+		max &= max - 1;
+	if (max <= 1)
+		return;
+
+	select_device_wait(d);
+	outb(reg_nsect(c), max);
+	issue_command(c, CMD_SET_MULTIPLE_MODE);
+	sema_down(&c->completion_wait);
+	wait_while_busy(d);
+	if ((inb(reg_status(c)) & STA_ERR) == 0)
+		d->multiple = max;
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+	BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+	Issues one command per MAX_SECTORS_PER_COMMAND sectors.
 	Internally synchronizes accesses to disks, so external
 	per-disk locking is unneeded. */
-static void ide_read(void* d_, block_sector_t sec_no, void* buffer)
+static void ide_read_multiple(void* d_, block_sector_t sec_no, size_t cnt, void* buffer_)
 {
 	struct ata_disk* d = d_;
 	struct channel* c = d->channel;
+	uint8_t* buffer = buffer_;
+
 	lock_acquire(&c->lock);
-	select_sector(d, sec_no);
-	issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-	sema_down(&c->completion_wait);
-	if (!wait_while_busy(d))
-		PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-	input_sector(c, buffer);
+	while (cnt > 0) {
+		size_t sector_cnt = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+
+		if (!d->dma || !dma_transfer(d, sec_no, sector_cnt, buffer, false))
+			pio_read(d, sec_no, sector_cnt, buffer);
+		sec_no += sector_cnt;
+		buffer += sector_cnt * BLOCK_SECTOR_SIZE;
+		cnt -= sector_cnt;
+	}
 	lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-	BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-	acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+	BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+	Returns after the disk has acknowledged receiving the data.
+	Issues one command per MAX_SECTORS_PER_COMMAND sectors.
 	Internally synchronizes accesses to disks, so external
 	per-disk locking is unneeded. */
-static void ide_write(void* d_, block_sector_t sec_no, const void* buffer)
+static void ide_write_multiple(
+	 void* d_, block_sector_t sec_no, size_t cnt, const void* buffer_)
 {
 	struct ata_disk* d = d_;
 	struct channel* c = d->channel;
+	const uint8_t* buffer = buffer_;
+
 	lock_acquire(&c->lock);
-	select_sector(d, sec_no);
-	issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy(d))
-		PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-	output_sector(c, buffer);
-	sema_down(&c->completion_wait);
+	while (cnt > 0) {
+		size_t sector_cnt = cnt < MAX_SECTORS_PER_COMMAND ? cnt : MAX_SECTORS_PER_COMMAND;
+
+		if (!d->dma || !dma_transfer(d, sec_no, sector_cnt, (void*) buffer, true))
+			pio_write(d, sec_no, sector_cnt, buffer);
+		sec_no += sector_cnt;
+		buffer += sector_cnt * BLOCK_SECTOR_SIZE;
+		cnt -= sector_cnt;
+	}
 	lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+	room for BLOCK_SECTOR_SIZE bytes. */
+static void ide_read(void* d, block_sector_t sec_no, void* buffer)
+{
+	ide_read_multiple(d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+	BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+	acknowledged receiving the data. */
+static void ide_write(void* d, block_sector_t sec_no, const void* buffer)
+{
+	ide_write_multiple(d, sec_no, 1, buffer);
+}
+
+static struct block_operations ide_operations = {
+	 ide_read, ide_write, ide_read_multiple, ide_write_multiple, NULL};
+
+/* Reads CNT sectors, at most MAX_SECTORS_PER_COMMAND, starting at
+	SEC_NO from disk D into BUFFER in PIO mode, taking one
+	interrupt per D->multiple sectors.  D's channel must be
+	locked. */
+static void pio_read(struct ata_disk* d, block_sector_t sec_no, size_t cnt, void* buffer_)
+{
+	struct channel* c = d->channel;
+	uint8_t* buffer = buffer_;
+	size_t done;
+
+	select_sector(d, sec_no, cnt);
+	issue_command(c, d->multiple > 1 ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+	for (done = 0; done < cnt; done += d->multiple) {
+		size_t block_cnt = cnt - done;
+
+		if (block_cnt > d->multiple)
+			block_cnt = d->multiple;
+
+		sema_down(&c->completion_wait);
+		if (!wait_while_busy(d))
+			PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + done);
+		input_sectors(c, buffer + done * BLOCK_SECTOR_SIZE, block_cnt);
+	}
+}
+
+/* Writes CNT sectors, at most MAX_SECTORS_PER_COMMAND, starting
+	at SEC_NO to disk D from BUFFER in PIO mode, taking one
+	interrupt per D->multiple sectors.  D's channel must be
+	locked. */
+static void pio_write(
+	 struct ata_disk* d, block_sector_t sec_no, size_t cnt, const void* buffer_)
+{
+	struct channel* c = d->channel;
+	const uint8_t* buffer = buffer_;
+	size_t done;
+
+	select_sector(d, sec_no, cnt);
+	issue_command(c, d->multiple > 1 ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+	for (done = 0; done < cnt; done += d->multiple) {
+		size_t block_cnt = cnt - done;
+
+		if (block_cnt > d->multiple)
+			block_cnt = d->multiple;
+
+		/* The disk interrupts when it is ready for each group of
+			sectors after the first. */
+		if (done > 0)
+			sema_down(&c->completion_wait);
+		if (!wait_while_busy(d))
+			PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + done);
+		output_sectors(c, buffer + done * BLOCK_SECTOR_SIZE, block_cnt);
+	}
+	sema_down(&c->completion_wait);
+}
+
+/* Transfers CNT sectors, at most MAX_SECTORS_PER_COMMAND,
+	starting at SEC_NO between disk D and BUFFER with bus master
+	DMA, writing to the disk if WRITE is true and reading from it
+	otherwise.  The current thread sleeps until the whole transfer
+	is done, leaving the CPU to other threads.  D's channel must be
+	locked.
+
+	Returns false without doing anything if BUFFER can't be used
+	for DMA, which requires a kernel address aligned on a 2-byte
+	boundary.  The caller should fall back to PIO in that case. */
+static bool dma_transfer(
+	 struct ata_disk* d, block_sector_t sec_no, size_t cnt, void* buffer, bool write)
+{
+	struct channel* c = d->channel;
+	struct prd* prd = prd_tables[c - channels];
+	uint8_t* p = buffer;
+	size_t left = cnt * BLOCK_SECTOR_SIZE;
+	size_t prd_cnt = 0;
+	uint8_t command = write ? 0 : BM_CMD_READ;
+	uint8_t status;
+
+	if (!is_kernel_vaddr(buffer) || (uintptr_t) buffer % 2 != 0)
+		return false;
+
+	/* Describe BUFFER one page at a time.  Kernel pages are
+		physically contiguous, and a page never crosses a 64 kB
+		boundary. */
+	while (left > 0) {
+		size_t size = PGSIZE - pg_ofs(p);
+		if (size > left)
+			size = left;
+
+		ASSERT(prd_cnt < PRD_CNT);
+		prd[prd_cnt].addr = vtop(p);
+		prd[prd_cnt].size = size;
+		prd[prd_cnt].flags = 0;
+		prd_cnt++;
+		p += size;
+		left -= size;
+	}
+	prd[prd_cnt - 1].flags = PRD_EOT;
+	barrier();
+
+	/* Program the bus master, then the disk, then start. */
+	outl(bm_prdt(c), vtop(prd));
+	outb(bm_command(c), command);
+	outb(bm_status(c), inb(bm_status(c)) | BM_STA_ERR | BM_STA_INTR);
+	select_sector(d, sec_no, cnt);
+	issue_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+	outb(bm_command(c), command | BM_CMD_START);
+
+	/* Wait for the disk's completion interrupt, then stop the bus
+		master and check for errors. */
+	sema_down(&c->completion_wait);
+	outb(bm_command(c), command);
+	status = inb(bm_status(c));
+	outb(bm_status(c), status | BM_STA_ERR | BM_STA_INTR);
+	if ((status & BM_STA_ERR) || (inb(reg_status(c)) & STA_ERR))
+		PANIC(
+			 "%s: disk DMA %s failed, sector=%" PRDSNu,
+			 d->name,
+			 write ? "write" : "read",
+			 sec_no);
+	return true;
+}
 
 /* Selects device D, waiting for it to become ready, and then
-	writes SEC_NO to the disk's sector selection registers.  (We
-	use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no)
+	writes SEC_NO to the disk's sector selection registers and CNT,
+	which must be between 1 and MAX_SECTORS_PER_COMMAND, to its
+	sector count register.  (We use LBA mode.) */
+static void select_sector(struct ata_disk* d, block_sector_t sec_no, size_t cnt)
 {
 	struct channel* c = d->channel;
 
 	ASSERT(sec_no < (1UL << 28));
+	ASSERT(cnt >= 1 && cnt <= MAX_SECTORS_PER_COMMAND);
 
 	select_device_wait(d);
-	outb(reg_nsect(c), 1);
+	outb(reg_nsect(c), cnt % MAX_SECTORS_PER_COMMAND); /* 0 means 256. */
 	outb(reg_lbal(c), sec_no);
 	outb(reg_lbam(c), sec_no >> 8);
 	outb(reg_lbah(c), (sec_no >> 16));
@@ -375,7 +644,7 @@ static void select_sector(struct ata_disk* d, block_sector_t sec_no)
 
 /* Writes COMMAND to channel C and prepares for receiving a
 	completion interrupt. */
-static void issue_pio_command(struct channel* c, uint8_t command)
+static void issue_command(struct channel* c, uint8_t command)
 {
 	/* Interrupts must be enabled or our semaphore will never be
 		up'd by the completion handler. */
@@ -385,18 +654,19 @@ static void issue_pio_command(struct channel* c, uint8_t command)
 	outb(reg_command(c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-	SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
-static void input_sector(struct channel* c, void* sector)
+/* Reads CNT sectors from channel C's data register in PIO mode
+	into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+	bytes. */
+static void input_sectors(struct channel* c, void* sectors, size_t cnt)
 {
-	insw(reg_data(c), sector, BLOCK_SECTOR_SIZE / 2);
+	insw(reg_data(c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-	SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
-static void output_sector(struct channel* c, const void* sector)
+/* Writes CNT sectors to channel C's data register in PIO mode.
+	SECTORS must contain CNT * BLOCK_SECTOR_SIZE bytes. */
+static void output_sectors(struct channel* c, const void* sectors, size_t cnt)
 {
-	outsw(reg_data(c), sector, BLOCK_SECTOR_SIZE / 2);
+	outsw(reg_data(c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
 /* Low-level ATA primitives. */
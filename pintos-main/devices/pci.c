@@ -0,0 +1,128 @@
+#include "devices/pci.h"
+
+#include "threads/io.h"
+
+#include <debug.h>
+
+/* This code is a minimal interface to the PCI bus, using
+	configuration mechanism #1 found on all PC chipsets since the
+	early 1990s.  It only enumerates devices and reads and writes
+	their configuration registers; drivers do the rest. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8 /* Selects a configuration register. */
+#define PCI_CONFIG_DATA		0xcfc /* Reads or writes the selected register. */
+
+/* Bus geometry. */
+#define PCI_BUS_CNT	256 /* Buses. */
+#define PCI_SLOT_CNT 32	/* Slots per bus. */
+#define PCI_FUNC_CNT 8	/* Functions per slot. */
+
+/* Header type register, and its multifunction bit. */
+#define PCI_REG_HEADER		  0x0c /* Header type 23:16. */
+#define PCI_HEADER_MULTIFUNC 0x80
+
+/* Vendor ID read back from an empty slot. */
+#define PCI_NO_VENDOR 0xffff
+
+/* Selects register REG of the device function at BUS, SLOT,
+	FUNC for the next access to PCI_CONFIG_DATA. */
+static void select_config(uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+	ASSERT(reg % 4 == 0);
+	outl(
+		 PCI_CONFIG_ADDRESS,
+		 0x80000000 | (bus << 16) | (slot << 11) | (func << 8) | reg);
+}
+
+/* Reads register REG of the device function at BUS, SLOT,
+	FUNC. */
+static uint32_t read_config(uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+	select_config(bus, slot, func, reg);
+	return inl(PCI_CONFIG_DATA);
+}
+
+/* Calls VISIT with AUX for each device function on the PCI
+	buses, in bus, slot, function order, until VISIT returns
+	false.  Returns false if VISIT did, true otherwise. */
+bool pci_for_each(pci_visit_func* visit, void* aux)
+{
+	int bus, slot, func;
+
+	for (bus = 0; bus < PCI_BUS_CNT; bus++)
+		for (slot = 0; slot < PCI_SLOT_CNT; slot++)
+			for (func = 0; func < PCI_FUNC_CNT; func++) {
+				uint32_t id = read_config(bus, slot, func, PCI_REG_ID);
+				uint32_t class_reg;
+				struct pci_device dev;
+
+				if ((id & 0xffff) == PCI_NO_VENDOR) {
+					/* No function 0 means an empty slot. */
+					if (func == 0)
+						break;
+					continue;
+				}
+
+				class_reg = read_config(bus, slot, func, PCI_REG_CLASS);
+				dev.bus = bus;
+				dev.slot = slot;
+				dev.func = func;
+				dev.vendor_id = id & 0xffff;
+				dev.device_id = id >> 16;
+				dev.class = class_reg >> 24;
+				dev.subclass = (class_reg >> 16) & 0xff;
+				dev.prog_if = (class_reg >> 8) & 0xff;
+				if (!visit(&dev, aux))
+					return false;
+
+				/* Only multifunction devices have functions past 0. */
+				if (func == 0
+					 && !((read_config(bus, slot, 0, PCI_REG_HEADER) >> 16) & PCI_HEADER_MULTIFUNC))
+					break;
+			}
+	return true;
+}
+
+/* pci_for_each() visitor for pci_find_class().  Stops at the
+	first device whose class and subclass match those in *AUX,
+	copying it into *AUX. */
+static bool match_class(const struct pci_device* dev, void* aux)
+{
+	struct pci_device* want = aux;
+
+	if (dev->class != want->class || dev->subclass != want->subclass)
+		return true;
+	*want = *dev;
+	return false;
+}
+
+/* Searches the PCI buses for a device function of the given
+	CLASS and SUBCLASS.  If one is found, stores its address and
+	identity in *DEV and returns true.  Otherwise returns false. */
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_device* dev)
+{
+	struct pci_device want;
+
+	want.class = class;
+	want.subclass = subclass;
+	if (pci_for_each(match_class, &want))
+		return false;
+	*dev = want;
+	return true;
+}
+
+/* Returns configuration register REG of DEV.  REG must be a
+	multiple of 4. */
+uint32_t pci_read_config(const struct pci_device* dev, uint8_t reg)
+{
+	return read_config(dev->bus, dev->slot, dev->func, reg);
+}
+
+/* Writes VALUE to configuration register REG of DEV.  REG must
+	be a multiple of 4. */
+void pci_write_config(const struct pci_device* dev, uint8_t reg, uint32_t value)
+{
+	select_config(dev->bus, dev->slot, dev->func, reg);
+	outl(PCI_CONFIG_DATA, value);
+}
@@ -0,0 +1,42 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI device function. */
+struct pci_device {
+	uint8_t bus, slot, func; /* Configuration space address. */
+	uint16_t vendor_id;		 /* Vendor. */
+	uint16_t device_id;		 /* Device, as numbered by vendor. */
+	uint8_t class;				 /* Base class, e.g. 0x01 = storage. */
+	uint8_t subclass;			 /* Subclass, e.g. 0x01 = IDE. */
+	uint8_t prog_if;			 /* Programming interface. */
+};
+
+/* Configuration space registers, as byte offsets. */
+#define PCI_REG_ID		  0x00 /* Device ID 31:16, Vendor ID 15:0. */
+#define PCI_REG_COMMAND	  0x04 /* Status 31:16, Command 15:0. */
+#define PCI_REG_CLASS	  0x08 /* Class 31:24, Subclass 23:16, Prog IF 15:8. */
+#define PCI_REG_BAR(N)	  (0x10 + 4 * (N)) /* Base address register N. */
+#define PCI_REG_INTERRUPT 0x3c /* Interrupt line 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO			 0x0001 /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY		 0x0002 /* Respond to memory space accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* May act as bus master. */
+
+/* Base address register bits. */
+#define PCI_BAR_IO		  0x1			  /* BAR is in I/O space. */
+#define PCI_BAR_IO_MASK	  0xfffffffc /* I/O space base address. */
+
+/* Called for each device function by pci_for_each().  Returns
+	false to stop the enumeration. */
+typedef bool pci_visit_func(const struct pci_device*, void* aux);
+
+bool pci_for_each(pci_visit_func*, void* aux);
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_device*);
+uint32_t pci_read_config(const struct pci_device*, uint8_t reg);
+void pci_write_config(const struct pci_device*, uint8_t reg, uint32_t);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,144 @@
+#include "devices/raid0.h"
+
+#include "devices/block.h"
+
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A RAID-0 (striped) block device, "md0", built from up to
+	RAID0_MAX_MEMBERS other block devices.  Its sectors are dealt
+	out to the members in stripe units of RAID0_CHUNK sectors,
+	round-robin, so that a large transfer is split among all the
+	members.  The pieces are submitted to the members together and
+	waited for together, so members on different IDE channels
+	work in parallel. */
+
+/* Most member devices. */
+#define RAID0_MAX_MEMBERS 4
+
+/* Sectors per stripe unit. */
+#define RAID0_CHUNK 8
+
+/* Most pieces in flight at once for one transfer. */
+#define RAID0_BATCH 16
+
+/* The striped device. */
+struct raid0 {
+	struct block* members[RAID0_MAX_MEMBERS]; /* Member devices. */
+	size_t member_cnt;								/* Number of members. */
+};
+
+static struct raid0 raid0;
+
+static struct block_operations raid0_operations;
+
+/* Creates md0 from the block devices named in MEMBERS, a
+	comma-separated list such as "hdb,hdc", and registers it as a
+	raw block device.  Each member contributes as many whole stripe
+	units as fit in the smallest member.  Panics if a member doesn't
+	exist. */
+void raid0_init(char* members)
+{
+	block_sector_t member_size = 0;
+	char extra_info[64];
+	char *name, *save_ptr;
+	size_t i;
+
+	raid0.member_cnt = 0;
+	strlcpy(extra_info, "RAID-0 of", sizeof extra_info);
+	for (name = strtok_r(members, ",", &save_ptr); name != NULL;
+		  name = strtok_r(NULL, ",", &save_ptr)) {
+		struct block* block = block_get_by_name(name);
+
+		if (block == NULL)
+			PANIC("raid0: no such block device \"%s\"", name);
+		if (raid0.member_cnt >= RAID0_MAX_MEMBERS)
+			PANIC("raid0: more than %d members", RAID0_MAX_MEMBERS);
+		for (i = 0; i < raid0.member_cnt; i++)
+			if (raid0.members[i] == block)
+				PANIC("raid0: %s is listed twice", name);
+
+		raid0.members[raid0.member_cnt++] = block;
+		if (member_size == 0 || block_size(block) < member_size)
+			member_size = block_size(block);
+		strlcat(extra_info, " ", sizeof extra_info);
+		strlcat(extra_info, name, sizeof extra_info);
+	}
+	if (raid0.member_cnt == 0)
+		PANIC("raid0: no members");
+
+	member_size -= member_size % RAID0_CHUNK;
+	block_register(
+		 "md0",
+		 BLOCK_RAW,
+		 extra_info,
+		 member_size * raid0.member_cnt,
+		 &raid0_operations,
+		 &raid0);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between striped
+	device R and BUFFER, writing to R if WRITE is true and reading
+	from it otherwise.  Splits the transfer into stripe units and
+	submits up to RAID0_BATCH of them at a time to the members
+	before waiting for them. */
+static void raid0_transfer(
+	 struct raid0* r, bool write, block_sector_t sector, size_t cnt, void* buffer_)
+{
+	struct block_request requests[RAID0_BATCH];
+	uint8_t* buffer = buffer_;
+
+	while (cnt > 0) {
+		size_t req_cnt = 0;
+		size_t i;
+
+		for (; cnt > 0 && req_cnt < RAID0_BATCH; req_cnt++) {
+			block_sector_t stripe = sector / RAID0_CHUNK;
+			size_t ofs = sector % RAID0_CHUNK;
+			size_t piece = RAID0_CHUNK - ofs < cnt ? RAID0_CHUNK - ofs : cnt;
+			struct block* member = r->members[stripe % r->member_cnt];
+			block_sector_t member_sector = stripe / r->member_cnt * RAID0_CHUNK + ofs;
+
+			block_request_init(
+				 &requests[req_cnt], write, member_sector, piece, buffer, NULL, NULL);
+			block_submit(member, &requests[req_cnt]);
+			sector += piece;
+			buffer += piece * BLOCK_SECTOR_SIZE;
+			cnt -= piece;
+		}
+
+		for (i = 0; i < req_cnt; i++)
+			block_wait(&requests[i]);
+	}
+}
+
+/* Reads the CNT sectors starting at SECTOR from striped device
+	R_ into BUFFER. */
+static void raid0_read_multiple(void* r_, block_sector_t sector, size_t cnt, void* buffer)
+{
+	raid0_transfer(r_, false, sector, cnt, buffer);
+}
+
+/* Writes the CNT sectors starting at SECTOR to striped device R_
+	from BUFFER. */
+static void raid0_write_multiple(
+	 void* r_, block_sector_t sector, size_t cnt, const void* buffer)
+{
+	raid0_transfer(r_, true, sector, cnt, (void*) buffer);
+}
+
+/* Reads sector SECTOR from striped device R_ into BUFFER. */
+static void raid0_read(void* r_, block_sector_t sector, void* buffer)
+{
+	raid0_transfer(r_, false, sector, 1, buffer);
+}
+
+/* Writes sector SECTOR to striped device R_ from BUFFER. */
+static void raid0_write(void* r_, block_sector_t sector, const void* buffer)
+{
+	raid0_transfer(r_, true, sector, 1, (void*) buffer);
+}
+
+static struct block_operations raid0_operations = {
+	 raid0_read, raid0_write, raid0_read_multiple, raid0_write_multiple, NULL};
@@ -0,0 +1,91 @@
+#include "devices/ramdisk.h"
+
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+
+/* A block device held in kernel memory, "rd0".  It is registered
+	as a raw device, so it takes on a role only when named by
+	-filesys, -scratch, or -swap.  Its contents do not survive a
+	reboot, so it must be formatted with -f to hold a file
+	system. */
+
+/* Sectors per page of backing memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The RAM disk's backing store.  The pages need not be
+	contiguous, so they are allocated one at a time. */
+static void** pages;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates rd0 with KB kilobytes of zeroed storage, rounded up to
+	a whole page, and registers it as a raw block device.  Panics
+	if there is not enough memory. */
+void ramdisk_init(size_t kb)
+{
+	size_t page_cnt = DIV_ROUND_UP(kb * 1024, PGSIZE);
+	size_t i;
+
+	if (page_cnt == 0)
+		return;
+
+	pages = malloc(page_cnt * sizeof *pages);
+	if (pages == NULL)
+		PANIC("ramdisk: out of memory");
+	for (i = 0; i < page_cnt; i++) {
+		pages[i] = palloc_get_page(PAL_ZERO);
+		if (pages[i] == NULL)
+			PANIC("ramdisk: out of memory after %zu of %zu pages", i, page_cnt);
+	}
+
+	block_register(
+		 "rd0", BLOCK_RAW, "RAM disk", page_cnt * SECTORS_PER_PAGE, &ramdisk_operations, NULL);
+}
+
+/* Returns the address of SECTOR's contents. */
+static uint8_t* sector_addr(block_sector_t sector)
+{
+	return (uint8_t*) pages[sector / SECTORS_PER_PAGE]
+			 + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER_. */
+static void ramdisk_read_multiple(void* aux UNUSED, block_sector_t sector, size_t cnt, void* buffer_)
+{
+	uint8_t* buffer = buffer_;
+
+	for (; cnt > 0; sector++, cnt--, buffer += BLOCK_SECTOR_SIZE)
+		memcpy(buffer, sector_addr(sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the CNT sectors starting at SECTOR from BUFFER_. */
+static void ramdisk_write_multiple(
+	 void* aux UNUSED, block_sector_t sector, size_t cnt, const void* buffer_)
+{
+	const uint8_t* buffer = buffer_;
+
+	for (; cnt > 0; sector++, cnt--, buffer += BLOCK_SECTOR_SIZE)
+		memcpy(sector_addr(sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads sector SECTOR into BUFFER. */
+static void ramdisk_read(void* aux, block_sector_t sector, void* buffer)
+{
+	ramdisk_read_multiple(aux, sector, 1, buffer);
+}
+
+/* Writes sector SECTOR from BUFFER. */
+static void ramdisk_write(void* aux, block_sector_t sector, const void* buffer)
+{
+	ramdisk_write_multiple(aux, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations = {
+	 ramdisk_read, ramdisk_write, ramdisk_read_multiple, ramdisk_write_multiple, NULL};
@@ -21,6 +21,10 @@ static int64_t ticks;
 	Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Number of CPU time-stamp counter cycles per second, or 0 before
+	timer_calibrate().  Used by timer_usecs(). */
+static uint64_t tsc_per_sec;
+
 struct list sleeping_threads;
 
 static intr_handler_func timer_interrupt;
@@ -28,6 +32,7 @@ static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
+static uint64_t rdtsc(void);
 static bool thread_sleep_time_comparator(struct list_elem *a, struct list_elem *b, void *aux UNUSED);
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
 	and registers the corresponding interrupt. */
@@ -63,6 +68,43 @@ void timer_calibrate(void)
 			loops_per_tick |= test_bit;
 
 	printf("%'" PRIu64 " loops/s.\n", (uint64_t)loops_per_tick * TIMER_FREQ);
+
+	/* Count time-stamp counter cycles over about 50 ms, starting
+		at a tick boundary. */
+	{
+		int64_t calibrate_ticks = TIMER_FREQ / 20 > 0 ? TIMER_FREQ / 20 : 1;
+		int64_t start = ticks;
+		uint64_t tsc_start;
+
+		while (ticks == start)
+			barrier();
+		start = ticks;
+		tsc_start = rdtsc();
+		while (ticks - start < calibrate_ticks)
+			barrier();
+		tsc_per_sec = (rdtsc() - tsc_start) * TIMER_FREQ / calibrate_ticks;
+	}
+}
+
+/* Returns the CPU's time-stamp counter. */
+static uint64_t rdtsc(void)
+{
+	uint64_t tsc;
+	asm volatile("rdtsc" : "=A"(tsc));
+	return tsc;
+}
+
+/* Returns the number of microseconds since the CPU was reset,
+	measured with the CPU's time-stamp counter, which is much finer
+	grained than timer_ticks().  Returns 0 before
+	timer_calibrate(). */
+int64_t timer_usecs(void)
+{
+	uint64_t tsc = rdtsc();
+
+	if (tsc_per_sec == 0)
+		return 0;
+	return tsc / tsc_per_sec * 1000000 + tsc % tsc_per_sec * 1000000 / tsc_per_sec;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
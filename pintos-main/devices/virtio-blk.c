@@ -0,0 +1,391 @@
+#include "devices/virtio-blk.h"
+
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+#include <debug.h>
+#include <list.h>
+#include <packed.h>
+#include <round.h>
+#include <stdio.h>
+
+/* This file implements a driver for virtio block devices, as
+	provided by QEMU's "-drive if=virtio", through the legacy
+	virtio PCI interface described in version 0.9.5 of the virtio
+	specification.
+
+	Each request is a chain of three descriptors in the device's
+	single virtqueue: a header naming the operation and sector,
+	the data buffer, and a status byte for the device to fill in.
+	As many requests as the virtqueue has room for may be in
+	flight at once.  The device completes them in any order and
+	raises an interrupt, and a kernel thread per disk then hands
+	the finished requests back to the block layer. */
+
+/* PCI identity of a legacy (or transitional) virtio block
+	device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio registers, as offsets from the I/O port base in
+	BAR 0. */
+#define VIRTIO_REG_HOST_FEATURES  0x00 /* Features offered by device. */
+#define VIRTIO_REG_GUEST_FEATURES 0x04 /* Features used by driver. */
+#define VIRTIO_REG_QUEUE_PFN		 0x08 /* Page number of selected queue. */
+#define VIRTIO_REG_QUEUE_SIZE		 0x0c /* Descriptors in selected queue. */
+#define VIRTIO_REG_QUEUE_SELECT	 0x0e /* Selects a queue. */
+#define VIRTIO_REG_QUEUE_NOTIFY	 0x10 /* Announces new buffers. */
+#define VIRTIO_REG_STATUS			 0x12 /* Device status. */
+#define VIRTIO_REG_ISR				 0x13 /* Interrupt status; reading clears. */
+#define VIRTIO_REG_CAPACITY		 0x14 /* Block device size in sectors. */
+
+/* Device status bits. */
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01 /* Driver found the device. */
+#define VIRTIO_STATUS_DRIVER		 0x02 /* Driver can drive it. */
+#define VIRTIO_STATUS_DRIVER_OK	 0x04 /* Driver is ready. */
+#define VIRTIO_STATUS_FAILED		 0x80 /* Driver gave up. */
+
+/* Interrupt status bits. */
+#define VIRTIO_ISR_QUEUE 0x01 /* A virtqueue has used buffers. */
+
+/* Virtqueue descriptor flags. */
+#define VRING_DESC_F_NEXT	0x1 /* NEXT is valid. */
+#define VRING_DESC_F_WRITE 0x2 /* Device writes to the buffer. */
+
+/* Block request types and status values. */
+#define VIRTIO_BLK_T_IN	  0 /* Read. */
+#define VIRTIO_BLK_T_OUT  1 /* Write. */
+#define VIRTIO_BLK_S_OK	  0 /* Success. */
+
+/* A virtqueue's descriptor table entry. */
+struct vring_desc {
+	uint64_t addr;	  /* Physical address of buffer. */
+	uint32_t len;	  /* Length of buffer in bytes. */
+	uint16_t flags;  /* VRING_DESC_F_*. */
+	uint16_t next;	  /* Next descriptor in chain, if F_NEXT. */
+} PACKED;
+
+/* A virtqueue's ring of descriptor chains offered to the
+	device. */
+struct vring_avail {
+	uint16_t flags;	 /* Unused. */
+	uint16_t idx;		 /* Where the driver puts the next entry. */
+	uint16_t ring[];	 /* Heads of descriptor chains. */
+} PACKED;
+
+/* An entry in a virtqueue's ring of used descriptor chains. */
+struct vring_used_elem {
+	uint32_t id;  /* Head of descriptor chain. */
+	uint32_t len; /* Bytes written into the chain's buffers. */
+} PACKED;
+
+/* A virtqueue's ring of descriptor chains the device is done
+	with. */
+struct vring_used {
+	uint16_t flags;					  /* Unused. */
+	uint16_t idx;						  /* Where the device puts the next entry. */
+	struct vring_used_elem ring[]; /* Used descriptor chains. */
+} PACKED;
+
+/* Header at the start of every block request. */
+struct virtio_blk_header {
+	uint32_t type;		/* VIRTIO_BLK_T_*. */
+	uint32_t reserved; /* Must be 0. */
+	uint64_t sector;	/* First sector. */
+} PACKED;
+
+/* Descriptors in each request's chain: header, data, status. */
+#define DESCS_PER_REQUEST 3
+
+/* The per-request memory the device reads and writes, other
+	than the data itself.  Slot I always uses descriptors
+	I * DESCS_PER_REQUEST and the two after it. */
+struct slot {
+	struct virtio_blk_header header; /* Request header. */
+	uint8_t status;						/* Written by device. */
+	struct block_request* request;	/* Request in flight, if any. */
+	struct list_elem elem;				/* Element in free_slots. */
+};
+
+/* Most virtio disks. */
+#define DISK_CNT 4
+
+/* A virtio disk. */
+struct virtio_disk {
+	char name[8];		/* Name, e.g. "vda". */
+	uint16_t io_base;	/* Base I/O port. */
+	uint8_t irq;		/* Interrupt vector. */
+
+	uint16_t queue_size;				  /* Descriptors in the virtqueue. */
+	struct vring_desc* desc;		  /* Descriptor table. */
+	volatile struct vring_avail* avail; /* Available ring. */
+	volatile struct vring_used* used;	  /* Used ring. */
+	uint16_t last_used;				  /* Next used ring entry to look at. */
+
+	struct slot* slots;				/* queue_size / DESCS_PER_REQUEST slots. */
+	struct lock lock;					/* Protects free_slots and AVAIL. */
+	struct list free_slots;			/* Slots without a request. */
+	struct semaphore slot_cnt;		/* Number of slots in free_slots. */
+	struct semaphore interrupt;	/* Up'd by the interrupt handler. */
+};
+
+static struct virtio_disk disks[DISK_CNT];
+static size_t disk_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool probe(const struct pci_device*, void* aux);
+static bool init_disk(struct virtio_disk*, const struct pci_device*);
+static void completion_thread(void* d_);
+static void interrupt_handler(struct intr_frame*);
+
+/* Finds the virtio block devices on the PCI bus and registers
+	each of them as a block device named vda, vdb, and so on. */
+void virtio_blk_init(void)
+{
+	pci_for_each(probe, NULL);
+}
+
+/* pci_for_each() visitor that sets up PCI device DEV if it is a
+	virtio block device. */
+static bool probe(const struct pci_device* dev, void* aux UNUSED)
+{
+	struct virtio_disk* d = &disks[disk_cnt];
+	struct block* block;
+	uint32_t capacity_hi;
+	block_sector_t capacity;
+	char extra_info[32];
+	char name[16];
+
+	if (dev->vendor_id != VIRTIO_VENDOR_ID || dev->device_id != VIRTIO_BLK_DEVICE_ID)
+		return true;
+	if (disk_cnt >= DISK_CNT) {
+		printf("virtio-blk: ignoring device past the first %d\n", DISK_CNT);
+		return false;
+	}
+
+	snprintf(d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+	if (!init_disk(d, dev))
+		return true;
+	disk_cnt++;
+
+	snprintf(name, sizeof name, "%s-io", d->name);
+	thread_create_daemon(name, PRI_DEFAULT, completion_thread, d);
+
+	/* Capacity is 64 bits, more than a block_sector_t can hold. */
+	capacity = inl(d->io_base + VIRTIO_REG_CAPACITY);
+	capacity_hi = inl(d->io_base + VIRTIO_REG_CAPACITY + 4);
+	if (capacity_hi != 0)
+		capacity = (block_sector_t) -1;
+
+	snprintf(
+		 extra_info,
+		 sizeof extra_info,
+		 "virtio, %zu requests",
+		 (size_t) d->queue_size / DESCS_PER_REQUEST);
+	block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &virtio_blk_operations, d);
+	partition_scan(block);
+	return true;
+}
+
+/* Brings up virtio block device DEV as disk D: enables it on the
+	PCI bus, negotiates features (none are needed), and sets up its
+	virtqueue and interrupt handler.  Returns true if successful,
+	false after printing a message otherwise. */
+static bool init_disk(struct virtio_disk* d, const struct pci_device* dev)
+{
+	uint32_t bar = pci_read_config(dev, PCI_REG_BAR(0));
+	uint8_t irq = pci_read_config(dev, PCI_REG_INTERRUPT) & 0xff;
+	size_t avail_size, used_size, page_cnt, slot_cnt, i;
+	uint8_t* ring;
+
+	if (!(bar & PCI_BAR_IO) || (bar & PCI_BAR_IO_MASK) == 0) {
+		printf("%s: no legacy I/O ports, ignoring\n", d->name);
+		return false;
+	}
+	if (irq >= 16) {
+		printf("%s: no interrupt line, ignoring\n", d->name);
+		return false;
+	}
+	d->io_base = bar & PCI_BAR_IO_MASK;
+	d->irq = irq + 0x20;
+	pci_write_config(
+		 dev,
+		 PCI_REG_COMMAND,
+		 pci_read_config(dev, PCI_REG_COMMAND) | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+
+	/* Reset the device and tell it we're here. */
+	outb(d->io_base + VIRTIO_REG_STATUS, 0);
+	outb(d->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+	outb(d->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+	inl(d->io_base + VIRTIO_REG_HOST_FEATURES);
+	outl(d->io_base + VIRTIO_REG_GUEST_FEATURES, 0);
+
+	/* Set up queue 0.  Its size is fixed by the device.  The
+		descriptor table and available ring share the first pages,
+		and the used ring starts on a page boundary after them. */
+	outw(d->io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+	d->queue_size = inw(d->io_base + VIRTIO_REG_QUEUE_SIZE);
+	slot_cnt = d->queue_size / DESCS_PER_REQUEST;
+	if (slot_cnt == 0) {
+		printf("%s: virtqueue too small, ignoring\n", d->name);
+		goto fail;
+	}
+	avail_size = ROUND_UP(
+		 sizeof *d->desc * d->queue_size + sizeof *d->avail + sizeof d->avail->ring[0] * d->queue_size,
+		 PGSIZE);
+	used_size = ROUND_UP(sizeof *d->used + sizeof d->used->ring[0] * d->queue_size, PGSIZE);
+	page_cnt = (avail_size + used_size) / PGSIZE;
+	ring = palloc_get_multiple(PAL_ZERO, page_cnt);
+	d->slots = malloc(slot_cnt * sizeof *d->slots);
+	if (ring == NULL || d->slots == NULL) {
+		printf("%s: out of memory, ignoring\n", d->name);
+		if (ring != NULL)
+			palloc_free_multiple(ring, page_cnt);
+		free(d->slots);
+		goto fail;
+	}
+	d->desc = (struct vring_desc*) ring;
+	d->avail = (struct vring_avail*) (ring + sizeof *d->desc * d->queue_size);
+	d->used = (struct vring_used*) (ring + avail_size);
+	d->last_used = 0;
+
+	lock_init(&d->lock);
+	list_init(&d->free_slots);
+	for (i = 0; i < slot_cnt; i++) {
+		d->slots[i].request = NULL;
+		list_push_back(&d->free_slots, &d->slots[i].elem);
+	}
+	sema_init(&d->slot_cnt, slot_cnt);
+	sema_init(&d->interrupt, 0);
+
+	/* Disks may share an interrupt line, but only one handler can
+		be registered for it. */
+	for (i = 0; i < disk_cnt; i++)
+		if (disks[i].irq == d->irq)
+			break;
+	if (i == disk_cnt)
+		intr_register_ext(d->irq, interrupt_handler, "virtio-blk");
+
+	outl(d->io_base + VIRTIO_REG_QUEUE_PFN, vtop(ring) / PGSIZE);
+	outb(
+		 d->io_base + VIRTIO_REG_STATUS,
+		 VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+	return true;
+
+fail:
+	outb(d->io_base + VIRTIO_REG_STATUS, VIRTIO_STATUS_FAILED);
+	return false;
+}
+
+/* Offers request R to disk D_'s virtqueue, first waiting for a
+	free slot if all of them are in use. */
+static void virtio_blk_submit(void* d_, struct block_request* r)
+{
+	struct virtio_disk* d = d_;
+	struct vring_desc* desc;
+	struct slot* s;
+	uint16_t head;
+
+	sema_down(&d->slot_cnt);
+	lock_acquire(&d->lock);
+	s = list_entry(list_pop_front(&d->free_slots), struct slot, elem);
+	head = (s - d->slots) * DESCS_PER_REQUEST;
+
+	s->header.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	s->header.reserved = 0;
+	s->header.sector = r->sector;
+	s->status = 0xff;
+	s->request = r;
+
+	desc = &d->desc[head];
+	desc[0].addr = vtop(&s->header);
+	desc[0].len = sizeof s->header;
+	desc[0].flags = VRING_DESC_F_NEXT;
+	desc[0].next = head + 1;
+	desc[1].addr = vtop(r->buffer);
+	desc[1].len = r->cnt * BLOCK_SECTOR_SIZE;
+	desc[1].flags = VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE);
+	desc[1].next = head + 2;
+	desc[2].addr = vtop(&s->status);
+	desc[2].len = sizeof s->status;
+	desc[2].flags = VRING_DESC_F_WRITE;
+	desc[2].next = 0;
+
+	/* The device may look at the ring entry as soon as it sees the
+		new index, so the entry has to be written first. */
+	d->avail->ring[d->avail->idx % d->queue_size] = head;
+	barrier();
+	d->avail->idx++;
+	lock_release(&d->lock);
+
+	outw(d->io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+}
+
+/* Completion thread for disk D_.  Each time the interrupt handler
+	wakes it up, returns the slots of the requests the device has
+	finished and completes the requests. */
+static void completion_thread(void* d_)
+{
+	struct virtio_disk* d = d_;
+
+	for (;;) {
+		struct list done;
+		size_t freed = 0;
+
+		list_init(&done);
+		sema_down(&d->interrupt);
+
+		lock_acquire(&d->lock);
+		while (d->last_used != d->used->idx) {
+			volatile struct vring_used_elem* e = &d->used->ring[d->last_used % d->queue_size];
+			struct slot* s;
+
+			barrier();
+			s = &d->slots[e->id / DESCS_PER_REQUEST];
+			if (s->status != VIRTIO_BLK_S_OK)
+				PANIC(
+					 "%s: disk %s failed, sector=%" PRDSNu,
+					 d->name,
+					 s->request->write ? "write" : "read",
+					 s->request->sector);
+
+			list_push_back(&done, &s->request->elem);
+			s->request = NULL;
+			list_push_back(&d->free_slots, &s->elem);
+			freed++;
+			d->last_used++;
+		}
+		lock_release(&d->lock);
+
+		while (freed-- > 0)
+			sema_up(&d->slot_cnt);
+		while (!list_empty(&done))
+			block_complete(list_entry(list_pop_front(&done), struct block_request, elem));
+	}
+}
+
+/* Virtio block interrupt handler.  Acknowledges the interrupt on
+	each disk on its line and wakes up the completion threads of
+	those with finished requests. */
+static void interrupt_handler(struct intr_frame* f)
+{
+	size_t i;
+
+	for (i = 0; i < disk_cnt; i++) {
+		struct virtio_disk* d = &disks[i];
+		if (d->irq == f->vec_no && (inb(d->io_base + VIRTIO_REG_ISR) & VIRTIO_ISR_QUEUE))
+			sema_up(&d->interrupt);
+	}
+}
+
+static struct block_operations virtio_blk_operations = {
+	 NULL, NULL, NULL, NULL, virtio_blk_submit};
@@ -0,0 +1,6 @@
+#ifndef DEVICES_VIRTIO_BLK_H
+#define DEVICES_VIRTIO_BLK_H
+
+void virtio_blk_init(void);
+
+#endif /* devices/virtio-blk.h */
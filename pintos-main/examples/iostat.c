@@ -0,0 +1,59 @@
+/* iostat.c
+
+	Prints the I/O statistics of every block device: bytes
+	transferred, request counts and sizes, queue depth, and the
+	request latency histogram. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+/* Prints TOTAL / CNT with one decimal place, or 0 if CNT is 0. */
+static void print_mean(unsigned long long total, unsigned long long cnt)
+{
+	unsigned long long tenths = cnt > 0 ? (total * 10 + cnt / 2) / cnt : 0;
+	printf("%llu.%llu", tenths / 10, tenths % 10);
+}
+
+int main(void)
+{
+	struct block_stats s;
+	unsigned idx;
+
+	for (idx = 0; blockstats(idx, &s); idx++) {
+		unsigned long long requests = s.read_requests + s.write_requests;
+		int i;
+
+		printf(
+			 "%s (%s): %llu bytes read, %llu bytes written\n",
+			 s.name,
+			 s.type,
+			 s.read_bytes,
+			 s.write_bytes);
+		printf(
+			 "  requests: %llu reads, %llu writes, %u in flight\n",
+			 s.read_requests,
+			 s.write_requests,
+			 s.in_flight);
+		if (requests == 0)
+			continue;
+
+		printf("  queue depth: mean ");
+		print_mean(s.depth_total, requests);
+		printf(", max %u\n", s.max_in_flight);
+
+		printf("  size (sectors):");
+		for (i = 0; i < BLOCK_STATS_SIZE_CNT; i++)
+			if (s.size_hist[i] != 0)
+				printf(" %d+:%u", 1 << i, s.size_hist[i]);
+		printf("\n");
+
+		printf("  latency (us): mean ");
+		print_mean(s.latency_total, requests - s.in_flight);
+		printf(",");
+		for (i = 0; i < BLOCK_STATS_LATENCY_CNT; i++)
+			if (s.latency_hist[i] != 0)
+				printf(" %d+:%u", i > 0 ? 1 << i : 0, s.latency_hist[i]);
+		printf("\n");
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,575 @@
+#include "filesys/cache.h"
+
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The buffer cache sits between the file system and fs_device.
+	Every sector the file system touches is read into one of
+	CACHE_SIZE entries and modified there.  Dirty entries are
+	written back by the flusher thread once they grow old, when
+	they are evicted, or when the cache is flushed.  Eviction uses
+	the clock (second-chance) algorithm.  Runs of contiguous
+	sectors are read and written back with one transfer each,
+	through a bounce buffer. */
+
+/* A cached sector. */
+struct cache_entry {
+	block_sector_t sector; /* Sector held, if IN_USE. */
+	bool in_use;			  /* Does this entry hold a sector? */
+	bool dirty;				  /* Modified since read from disk? */
+	int64_t dirty_time;	  /* Timer tick at which DIRTY was set. */
+	bool accessed;			  /* Used since the clock hand last passed? */
+	int pin_cnt;			  /* Threads using or waiting for this entry. */
+	bool writing_back;	  /* Still writing back the sector it held before? */
+	block_sector_t old_sector; /* That sector, if WRITING_BACK. */
+
+	struct lock lock;						/* Protects DATA. */
+	uint8_t data[BLOCK_SECTOR_SIZE]; /* Sector contents. */
+};
+
+static struct cache_entry cache[CACHE_SIZE];
+
+/* Protects the sector held by each entry, pin counts, accessed
+	bits, write-back state, the clock hand and the dirty count.  It
+	is never held across disk I/O: a dirty entry that is evicted is
+	pointed at its new sector under CACHE_LOCK and then written
+	back holding only the entry's lock, and until that is done
+	anyone looking up the old sector waits on the entry's lock
+	rather than read stale data from disk.  An entry's DIRTY and
+	DIRTY_TIME change only with both CACHE_LOCK and the entry's
+	lock held, so either lock is enough to read them.  An entry's
+	lock is acquired with CACHE_LOCK held only if the entry is
+	unpinned, when it cannot block; otherwise it comes first. */
+static struct lock cache_lock;
+
+/* Signaled when an entry's pin count drops to zero, for threads
+	that found every entry pinned.  Used with CACHE_LOCK. */
+static struct condition entry_unpinned;
+
+/* Next entry the clock algorithm will consider. */
+static size_t clock_hand;
+
+/* Number of dirty entries. */
+static size_t dirty_cnt;
+
+/* Upped to make the flusher thread run write_behind(), by the
+	flush timer every CACHE_FLUSH_INTERVAL ticks and by writers as
+	soon as DIRTY_CNT passes CACHE_DIRTY_LIMIT.  FLUSH_PENDING,
+	protected by CACHE_LOCK, keeps wakeups from piling up. */
+static struct semaphore flush_sema;
+static bool flush_pending;
+
+/* Sectors queued for the read-ahead thread, as a ring buffer.
+	Requests that don't fit are dropped. */
+#define READ_AHEAD_QUEUE_SIZE 64
+static block_sector_t ra_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t ra_head; /* Index of oldest request. */
+static size_t ra_cnt;  /* Number of queued requests. */
+static struct lock ra_lock;
+static struct condition ra_nonempty;
+
+/* Bounce buffer for multi-sector transfers.  RUN_LOCK is acquired
+	before CACHE_LOCK or any entry's lock. */
+static uint8_t run_buffer[CACHE_RUN_MAX * BLOCK_SECTOR_SIZE];
+static struct lock run_lock;
+
+static struct cache_entry* lookup(block_sector_t);
+static struct cache_entry* lookup_write_back(block_sector_t);
+static bool cached(block_sector_t);
+static struct cache_entry* evict(void);
+static bool claim(struct cache_entry*, block_sector_t);
+static void finish_write_back(struct cache_entry*);
+static void unpin(struct cache_entry*);
+static struct cache_entry* cache_get(block_sector_t, bool load);
+static void cache_put(struct cache_entry*);
+static void read_ahead_thread(void* aux);
+static void flusher_thread(void* aux);
+static void flush_timer_thread(void* aux);
+static void wake_flusher(void);
+static void write_behind(bool all);
+static void write_run(struct cache_entry* run[], size_t cnt);
+
+/* Initializes the buffer cache. */
+void cache_init(void)
+{
+	size_t i;
+
+	lock_init(&cache_lock);
+	cond_init(&entry_unpinned);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		cache[i].in_use = false;
+		cache[i].dirty = false;
+		cache[i].accessed = false;
+		cache[i].pin_cnt = 0;
+		cache[i].writing_back = false;
+		lock_init(&cache[i].lock);
+	}
+	clock_hand = 0;
+	dirty_cnt = 0;
+	sema_init(&flush_sema, 0);
+	flush_pending = false;
+	lock_init(&run_lock);
+
+	lock_init(&ra_lock);
+	cond_init(&ra_nonempty);
+	ra_head = ra_cnt = 0;
+	thread_create_daemon("read-ahead", PRI_DEFAULT, read_ahead_thread, NULL);
+	thread_create_daemon("flusher", PRI_DEFAULT, flusher_thread, NULL);
+	thread_create_daemon("flush-timer", PRI_DEFAULT, flush_timer_thread, NULL);
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+	BLOCK_SECTOR_SIZE bytes. */
+void cache_read(block_sector_t sector, void* buffer)
+{
+	cache_read_at(sector, buffer, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER to sector SECTOR. */
+void cache_write(block_sector_t sector, const void* buffer)
+{
+	cache_write_at(sector, buffer, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR into
+	BUFFER. */
+void cache_read_at(block_sector_t sector, void* buffer, size_t size, size_t ofs)
+{
+	struct cache_entry* e;
+
+	ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+	e = cache_get(sector, true);
+	memcpy(buffer, e->data + ofs, size);
+	cache_put(e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+	offset OFS within the sector.  The data reaches the disk when
+	the entry is evicted or flushed. */
+void cache_write_at(block_sector_t sector, const void* buffer, size_t size, size_t ofs)
+{
+	struct cache_entry* e;
+
+	ASSERT(ofs + size <= BLOCK_SECTOR_SIZE);
+
+	/* A write that covers the whole sector doesn't need the old
+		contents. */
+	e = cache_get(sector, ofs > 0 || size < BLOCK_SECTOR_SIZE);
+	memcpy(e->data + ofs, buffer, size);
+	if (!e->dirty) {
+		lock_acquire(&cache_lock);
+		e->dirty = true;
+		e->dirty_time = timer_ticks();
+		if (++dirty_cnt > CACHE_DIRTY_LIMIT)
+			wake_flusher();
+		lock_release(&cache_lock);
+	}
+	cache_put(e);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache in
+	the background.  Does nothing if SECTOR is already cached or
+	too many requests are pending. */
+void cache_read_ahead(block_sector_t sector)
+{
+	bool present;
+
+	lock_acquire(&cache_lock);
+	present = cached(sector);
+	lock_release(&cache_lock);
+	if (present)
+		return;
+
+	lock_acquire(&ra_lock);
+	if (ra_cnt < READ_AHEAD_QUEUE_SIZE) {
+		ra_queue[(ra_head + ra_cnt) % READ_AHEAD_QUEUE_SIZE] = sector;
+		ra_cnt++;
+		cond_signal(&ra_nonempty, &ra_lock);
+	}
+	lock_release(&ra_lock);
+}
+
+/* Brings the CNT sectors starting at SECTOR into the cache,
+	reading each run of them that isn't already cached with a
+	single transfer.  Stops early, without waiting, if every entry
+	is in use. */
+void cache_prefetch(block_sector_t sector, size_t cnt)
+{
+	struct cache_entry* run[CACHE_RUN_MAX];
+	bool write_back[CACHE_RUN_MAX];
+
+	/* Don't wait for RUN_LOCK if there's nothing to read. */
+	lock_acquire(&cache_lock);
+	while (cnt > 0 && cached(sector)) {
+		sector++;
+		cnt--;
+	}
+	lock_release(&cache_lock);
+	if (cnt == 0)
+		return;
+
+	lock_acquire(&run_lock);
+	while (cnt > 0) {
+		size_t run_cnt = 0;
+		size_t i;
+
+		/* Skip sectors that are already cached. */
+		lock_acquire(&cache_lock);
+		while (cnt > 0 && cached(sector)) {
+			sector++;
+			cnt--;
+		}
+
+		/* Claim entries for the run of sectors that aren't. */
+		while (run_cnt < cnt && run_cnt < CACHE_RUN_MAX && !cached(sector + run_cnt)) {
+			struct cache_entry* e = evict();
+			if (e == NULL)
+				break;
+
+			write_back[run_cnt] = claim(e, sector + run_cnt);
+			run[run_cnt++] = e;
+		}
+		lock_release(&cache_lock);
+		if (run_cnt == 0)
+			break;
+
+		for (i = 0; i < run_cnt; i++)
+			if (write_back[i])
+				finish_write_back(run[i]);
+		block_read_multiple(fs_device, sector, run_cnt, run_buffer);
+		for (i = 0; i < run_cnt; i++) {
+			memcpy(run[i]->data, run_buffer + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+			cache_put(run[i]);
+		}
+		sector += run_cnt;
+		cnt -= run_cnt;
+	}
+	lock_release(&run_lock);
+}
+
+/* Writes every dirty entry back to disk.  This is the file
+	system's sync path, called by filesys_done() at shutdown and
+	after formatting; no system call exposes it to user programs. */
+void cache_flush(void)
+{
+	write_behind(true);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+	is not cached.  CACHE_LOCK must be held. */
+static struct cache_entry* lookup(block_sector_t sector)
+{
+	size_t i;
+
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].in_use && cache[i].sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Returns the entry that is writing back SECTOR after being
+	evicted from it, or a null pointer if there is none.
+	CACHE_LOCK must be held. */
+static struct cache_entry* lookup_write_back(block_sector_t sector)
+{
+	size_t i;
+
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].writing_back && cache[i].old_sector == sector)
+			return &cache[i];
+	return NULL;
+}
+
+/* Returns true if SECTOR is cached or still being written back,
+	that is, if its contents on disk may be stale.  CACHE_LOCK must
+	be held. */
+static bool cached(block_sector_t sector)
+{
+	return lookup(sector) != NULL || lookup_write_back(sector) != NULL;
+}
+
+/* Chooses an entry to reuse with the clock algorithm: free
+	entries are taken immediately, and entries that were accessed
+	since the hand last passed get a second chance.  Pinned entries
+	are skipped.  Returns a null pointer if every entry is pinned.
+	CACHE_LOCK must be held. */
+static struct cache_entry* evict(void)
+{
+	size_t i;
+
+	for (i = 0; i < 2 * CACHE_SIZE; i++) {
+		struct cache_entry* e = &cache[clock_hand];
+		clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+		if (!e->in_use)
+			return e;
+		if (e->pin_cnt > 0)
+			continue;
+		if (e->accessed)
+			e->accessed = false;
+		else
+			return e;
+	}
+	return NULL;
+}
+
+/* Returns the entry caching SECTOR with its lock held, bringing
+	SECTOR into the cache first if necessary.  If LOAD is false
+	the caller is going to overwrite the whole sector, so a newly
+	cached sector is not read from disk.  The entry stays pinned
+	until it is released with cache_put(). */
+static struct cache_entry* cache_get(block_sector_t sector, bool load)
+{
+	struct cache_entry* e;
+	bool write_back;
+
+	lock_acquire(&cache_lock);
+	for (;;) {
+		e = lookup(sector);
+		if (e != NULL) {
+			/* Hit.  Pinning keeps E from being evicted while we
+				wait for its lock. */
+			e->pin_cnt++;
+			e->accessed = true;
+			lock_release(&cache_lock);
+			lock_acquire(&e->lock);
+			return e;
+		}
+
+		e = lookup_write_back(sector);
+		if (e != NULL) {
+			/* SECTOR's last contents are still on their way to
+				disk.  Wait until they get there, then look again. */
+			e->pin_cnt++;
+			lock_release(&cache_lock);
+			lock_acquire(&e->lock);
+			lock_release(&e->lock);
+			lock_acquire(&cache_lock);
+			unpin(e);
+			continue;
+		}
+
+		e = evict();
+		if (e != NULL)
+			break;
+
+		/* Every entry is pinned.  Wait for one to be released. */
+		cond_wait(&entry_unpinned, &cache_lock);
+	}
+
+	/* Miss.  Anyone else looking for SECTOR now finds E and waits
+		on its lock until the data is in, and anyone looking for the
+		sector E held waits until it has been written back. */
+	write_back = claim(e, sector);
+	lock_release(&cache_lock);
+
+	if (write_back)
+		finish_write_back(e);
+	if (load)
+		block_read(fs_device, sector, e->data);
+	return e;
+}
+
+/* Takes over entry E, just chosen by evict(), for SECTOR: locks,
+	pins and points it at SECTOR.  Returns true if E held a dirty
+	sector, which the caller must write back with
+	finish_write_back() before touching E's data.  CACHE_LOCK must
+	be held.  E is unpinned, so nobody holds its lock and this does
+	not block. */
+static bool claim(struct cache_entry* e, block_sector_t sector)
+{
+	bool write_back = e->in_use && e->dirty;
+
+	lock_acquire(&e->lock);
+	if (write_back) {
+		e->writing_back = true;
+		e->old_sector = e->sector;
+		dirty_cnt--;
+	}
+	e->sector = sector;
+	e->in_use = true;
+	e->dirty = false;
+	e->accessed = true;
+	e->pin_cnt = 1;
+	return write_back;
+}
+
+/* Writes the sector that entry E held before claim() back to
+	disk, and lets threads waiting to look it up go ahead.  E's lock
+	must be held and CACHE_LOCK must not. */
+static void finish_write_back(struct cache_entry* e)
+{
+	block_write(fs_device, e->old_sector, e->data);
+
+	lock_acquire(&cache_lock);
+	e->writing_back = false;
+	lock_release(&cache_lock);
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void cache_put(struct cache_entry* e)
+{
+	lock_release(&e->lock);
+
+	lock_acquire(&cache_lock);
+	unpin(e);
+	lock_release(&cache_lock);
+}
+
+/* Drops a pin from E and, if that leaves E unpinned, wakes the
+	threads waiting for an evictable entry.  All of them, because
+	one that finds a hit when it looks again leaves E to the rest.
+	CACHE_LOCK must be held. */
+static void unpin(struct cache_entry* e)
+{
+	if (--e->pin_cnt == 0)
+		cond_broadcast(&entry_unpinned, &cache_lock);
+}
+
+/* Read-ahead thread.  Loads queued sectors into the cache so that
+	the reader that asked for them finds them there. */
+static void read_ahead_thread(void* aux UNUSED)
+{
+	for (;;) {
+		block_sector_t sector;
+		size_t cnt = 0;
+
+		/* Take the oldest request, along with any that follow it
+			on disk, and read them all at once. */
+		lock_acquire(&ra_lock);
+		while (ra_cnt == 0)
+			cond_wait(&ra_nonempty, &ra_lock);
+		sector = ra_queue[ra_head];
+		do {
+			ra_head = (ra_head + 1) % READ_AHEAD_QUEUE_SIZE;
+			ra_cnt--;
+			cnt++;
+		} while (ra_cnt > 0 && cnt < CACHE_RUN_MAX && ra_queue[ra_head] == sector + cnt);
+		lock_release(&ra_lock);
+
+		cache_prefetch(sector, cnt);
+	}
+}
+
+/* Flusher thread.  Each time it is woken, writes back sectors
+	that have been dirty for too long, or all of them if too many
+	are dirty, so that writers rarely wait for the disk. */
+static void flusher_thread(void* aux UNUSED)
+{
+	for (;;) {
+		bool all;
+
+		sema_down(&flush_sema);
+		lock_acquire(&cache_lock);
+		flush_pending = false;
+		all = dirty_cnt > CACHE_DIRTY_LIMIT;
+		lock_release(&cache_lock);
+		write_behind(all);
+	}
+}
+
+/* Flush timer thread.  Wakes the flusher every
+	CACHE_FLUSH_INTERVAL ticks so that old dirty sectors get
+	written back even when few sectors are dirty. */
+static void flush_timer_thread(void* aux UNUSED)
+{
+	for (;;) {
+		timer_sleep(CACHE_FLUSH_INTERVAL);
+		lock_acquire(&cache_lock);
+		wake_flusher();
+		lock_release(&cache_lock);
+	}
+}
+
+/* Wakes the flusher thread unless it has already been woken and
+	hasn't started its pass yet.  CACHE_LOCK must be held. */
+static void wake_flusher(void)
+{
+	if (!flush_pending) {
+		flush_pending = true;
+		sema_up(&flush_sema);
+	}
+}
+
+/* Writes back dirty entries in ascending sector order, to keep
+	the disk head moving in one direction, with one transfer for
+	each run of contiguous sectors.  Writes back every dirty entry
+	if ALL is true, otherwise only those that have been dirty for
+	at least CACHE_DIRTY_AGE ticks. */
+static void write_behind(bool all)
+{
+	struct cache_entry* victims[CACHE_SIZE];
+	size_t victim_cnt = 0;
+	size_t i;
+
+	/* Pick and pin the entries to write back, sorted by sector
+		with an insertion sort. */
+	lock_acquire(&cache_lock);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry* e = &cache[i];
+		size_t j;
+
+		if (!e->in_use || !e->dirty)
+			continue;
+		if (!all && timer_elapsed(e->dirty_time) < CACHE_DIRTY_AGE)
+			continue;
+
+		e->pin_cnt++;
+		for (j = victim_cnt; j > 0 && victims[j - 1]->sector > e->sector; j--)
+			victims[j] = victims[j - 1];
+		victims[j] = e;
+		victim_cnt++;
+	}
+	lock_release(&cache_lock);
+
+	lock_acquire(&run_lock);
+	for (i = 0; i < victim_cnt;) {
+		size_t run_cnt = 1;
+
+		while (i + run_cnt < victim_cnt && run_cnt < CACHE_RUN_MAX
+				 && victims[i + run_cnt]->sector == victims[i]->sector + run_cnt)
+			run_cnt++;
+		write_run(victims + i, run_cnt);
+		i += run_cnt;
+	}
+	lock_release(&run_lock);
+}
+
+/* Writes back RUN, CNT pinned entries that hold contiguous
+	sectors in ascending order, and unpins them.  Entries that are
+	no longer dirty split the run.  RUN_LOCK must be held. */
+static void write_run(struct cache_entry* run[], size_t cnt)
+{
+	size_t start, i;
+
+	for (i = 0; i < cnt; i++)
+		lock_acquire(&run[i]->lock);
+
+	for (start = 0; start < cnt; start = i + 1) {
+		/* Find the next stretch of entries that are still dirty. */
+		while (start < cnt && !run[start]->dirty)
+			start++;
+		for (i = start; i < cnt && run[i]->dirty; i++)
+			memcpy(run_buffer + (i - start) * BLOCK_SECTOR_SIZE, run[i]->data, BLOCK_SECTOR_SIZE);
+		if (i == start)
+			break;
+
+		block_write_multiple(fs_device, run[start]->sector, i - start, run_buffer);
+		lock_acquire(&cache_lock);
+		for (; start < i; start++) {
+			run[start]->dirty = false;
+			dirty_cnt--;
+		}
+		lock_release(&cache_lock);
+	}
+
+	for (i = 0; i < cnt; i++)
+		cache_put(run[i]);
+}
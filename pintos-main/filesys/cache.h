@@ -0,0 +1,34 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Number of sectors held by the buffer cache. */
+#define CACHE_SIZE 64
+
+/* Most contiguous sectors moved to or from the disk in one
+	transfer. */
+#define CACHE_RUN_MAX 16
+
+/* Write-behind tuning, in timer ticks (milliseconds at the default
+	-F=1000).  The flusher thread wakes up every FLUSH_INTERVAL and
+	writes back sectors that have been dirty for DIRTY_AGE or more.
+	It is also woken at once when more than DIRTY_LIMIT sectors
+	are dirty, and then writes back all of them. */
+#define CACHE_FLUSH_INTERVAL 250
+#define CACHE_DIRTY_AGE 1000
+#define CACHE_DIRTY_LIMIT (CACHE_SIZE / 2)
+
+void cache_init(void);
+void cache_read(block_sector_t, void*);
+void cache_write(block_sector_t, const void*);
+void cache_read_at(block_sector_t, void*, size_t size, size_t ofs);
+void cache_write_at(block_sector_t, const void*, size_t size, size_t ofs);
+void cache_read_ahead(block_sector_t);
+void cache_prefetch(block_sector_t, size_t cnt);
+void cache_flush(void);
+
+#endif /* filesys/cache.h */
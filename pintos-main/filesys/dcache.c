@@ -0,0 +1,161 @@
+#include "filesys/dcache.h"
+
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+
+/* The dentry cache remembers the results of recent directory
+	lookups, so that opening the same name again doesn't search the
+	directory.  Each dentry maps a name in a parent directory to
+	the sector of the named file's inode, or to sector 0 if the
+	name doesn't exist (a negative dentry).  No file's inode lives
+	in sector 0, which holds the free map's.  The directory code
+	invalidates dentries whenever it adds or removes a name, and
+	holds its own lock across a lookup and the inode_open() that
+	follows it, so that a file can't be removed in between.  When
+	the cache is full, the least recently used dentry is
+	replaced. */
+
+/* A cached name. */
+struct dentry {
+	struct hash_elem hash_elem; /* Element in DENTRIES, if in use. */
+	struct list_elem lru_elem;	 /* Element in LRU_LIST or FREE_LIST. */
+	block_sector_t parent;		 /* Parent directory's inode sector. */
+	block_sector_t sector;		 /* Named file's inode sector, or 0. */
+	char name[NAME_MAX + 1];	 /* Null terminated file name. */
+};
+
+static struct dentry dentry_pool[DCACHE_SIZE];
+
+/* Dentries in use, keyed on parent and name. */
+static struct hash dentries;
+
+/* Dentries in use, most recently used first. */
+static struct list lru_list;
+
+/* Dentries not in use. */
+static struct list free_list;
+
+/* Protects all of the above. */
+static struct lock dcache_lock;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+static struct dentry* find(block_sector_t parent, const char* name);
+
+/* Initializes the dentry cache. */
+void dcache_init(void)
+{
+	size_t i;
+
+	if (!hash_init(&dentries, dentry_hash, dentry_less, NULL))
+		PANIC("can't create dentry cache");
+	list_init(&lru_list);
+	list_init(&free_list);
+	for (i = 0; i < DCACHE_SIZE; i++)
+		list_push_back(&free_list, &dentry_pool[i].lru_elem);
+	lock_init(&dcache_lock);
+}
+
+/* Looks up NAME in the directory whose inode is in sector PARENT.
+	If the cache knows about NAME, returns true and sets *SECTOR to
+	the sector of its inode, or to 0 if NAME doesn't exist.
+	Otherwise returns false. */
+bool dcache_lookup(block_sector_t parent, const char* name, block_sector_t* sector)
+{
+	struct dentry* d;
+
+	lock_acquire(&dcache_lock);
+	d = find(parent, name);
+	if (d != NULL) {
+		list_remove(&d->lru_elem);
+		list_push_front(&lru_list, &d->lru_elem);
+		*sector = d->sector;
+	}
+	lock_release(&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+	PARENT refers to the inode in SECTOR, or doesn't exist if SECTOR
+	is 0. */
+void dcache_insert(block_sector_t parent, const char* name, block_sector_t sector)
+{
+	struct dentry* d;
+
+	if (strlen(name) > NAME_MAX)
+		return;
+
+	lock_acquire(&dcache_lock);
+	d = find(parent, name);
+	if (d != NULL)
+		list_remove(&d->lru_elem);
+	else {
+		/* Take a free dentry, or replace the least recently used. */
+		if (!list_empty(&free_list))
+			d = list_entry(list_pop_front(&free_list), struct dentry, lru_elem);
+		else {
+			d = list_entry(list_pop_back(&lru_list), struct dentry, lru_elem);
+			hash_delete(&dentries, &d->hash_elem);
+		}
+		d->parent = parent;
+		strlcpy(d->name, name, sizeof d->name);
+		hash_insert(&dentries, &d->hash_elem);
+	}
+	d->sector = sector;
+	list_push_front(&lru_list, &d->lru_elem);
+	lock_release(&dcache_lock);
+}
+
+/* Forgets anything known about NAME in the directory whose inode
+	is in sector PARENT. */
+void dcache_invalidate(block_sector_t parent, const char* name)
+{
+	struct dentry* d;
+
+	lock_acquire(&dcache_lock);
+	d = find(parent, name);
+	if (d != NULL) {
+		hash_delete(&dentries, &d->hash_elem);
+		list_remove(&d->lru_elem);
+		list_push_front(&free_list, &d->lru_elem);
+	}
+	lock_release(&dcache_lock);
+}
+
+/* Returns the dentry for NAME in PARENT, or a null pointer if
+	there is none.  DCACHE_LOCK must be held. */
+static struct dentry* find(block_sector_t parent, const char* name)
+{
+	struct dentry key;
+	struct hash_elem* e;
+
+	if (strlen(name) > NAME_MAX)
+		return NULL;
+	key.parent = parent;
+	strlcpy(key.name, name, sizeof key.name);
+	e = hash_find(&dentries, &key.hash_elem);
+	return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Returns a hash value for the dentry that contains E. */
+static unsigned dentry_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+	const struct dentry* d = hash_entry(e, struct dentry, hash_elem);
+	return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool dentry_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED)
+{
+	const struct dentry* a = hash_entry(a_, struct dentry, hash_elem);
+	const struct dentry* b = hash_entry(b_, struct dentry, hash_elem);
+
+	if (a->parent != b->parent)
+		return a->parent < b->parent;
+	return strcmp(a->name, b->name) < 0;
+}
@@ -0,0 +1,16 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include "devices/block.h"
+
+#include <stdbool.h>
+
+/* Number of names held by the dentry cache. */
+#define DCACHE_SIZE 128
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t parent, const char* name, block_sector_t*);
+void dcache_insert(block_sector_t parent, const char* name, block_sector_t);
+void dcache_invalidate(block_sector_t parent, const char* name);
+
+#endif /* filesys/dcache.h */
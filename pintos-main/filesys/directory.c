@@ -1,20 +1,28 @@
 #include "filesys/directory.h"
 
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/synch.h" 
+#include <hash.h>
 #include <list.h>
 #include <stdio.h>
 #include <string.h>
 
-struct lock dir_lock;
-
+/* Protects the entries of every directory and their indexes.
+	Lookups hold it for reading, so they run concurrently, including
+	the inode_open() that follows each one, which may go to disk.
+	Holding it keeps the file from being removed in between.
+	Adding or removing a name, and attaching or building an index,
+	hold it for writing. */
+static struct rwlock dir_lock;
 
 /* A directory. */
 struct dir {
-	struct inode* inode; /* Backing store. */
-	off_t pos;				/* Current position. */
+	struct inode* inode;		  /* Backing store. */
+	off_t pos;					  /* Current position. */
+	struct dir_index* index; /* Name index, or null if not yet used. */
 };
 
 /* A single directory entry. */
@@ -24,36 +32,69 @@ struct dir_entry {
 	bool in_use;					  /* In use or free? */
 };
 
+/* In-memory index of a directory's entries, shared by every
+	struct dir open on the same inode and built the first time one
+	of them looks up, adds or removes a name.  Each entry in the
+	directory file has a struct dir_slot, kept in NAMES if the
+	entry is in use and in FREE_SLOTS if not. */
+struct dir_index {
+	struct hash_elem elem;	 /* Element in DIR_INDEXES. */
+	block_sector_t sector;	 /* Directory's inode sector. */
+	int open_cnt;				 /* Number of struct dirs using this index. */
+	bool built;					 /* NAMES and FREE_SLOTS filled in? */
+	struct hash names;		 /* Entries in use, keyed on name. */
+	struct list free_slots; /* Entries not in use. */
+	off_t end;					 /* Offset just past the last entry. */
+};
+
+/* An entry in an indexed directory. */
+struct dir_slot {
+	union {
+		struct hash_elem hash_elem; /* Element in NAMES, if in use. */
+		struct list_elem list_elem; /* Element in FREE_SLOTS, if not. */
+	} elem;
+	off_t ofs;							 /* Byte offset in the directory. */
+	block_sector_t inode_sector;	 /* Sector number of header, if in use. */
+	char name[NAME_MAX + 1];		 /* Null terminated file name, if in use. */
+};
+
+/* Indexes of open directories, keyed on inode sector. */
+static struct hash dir_indexes;
+
+static hash_hash_func index_hash;
+static hash_less_func index_less;
+static void index_put(struct dir_index*);
 
 
 /* Creates a directory with space for ENTRY_CNT entries in the
 	given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt)
 {
-	//lock_init(&dir_lock);
 	return inode_create(sector, entry_cnt * sizeof(struct dir_entry));
 }
 
+/* Initializes the directory module. */
 void dir_init(void)
 {
-	lock_init(&dir_lock);
+	rwlock_init(&dir_lock);
+	dcache_init();
+	if (!hash_init(&dir_indexes, index_hash, index_less, NULL))
+		PANIC("can't create directory index table");
 }
 /* Opens and returns the directory for the given INODE, of which
 	it takes ownership.  Returns a null pointer on failure. */
 struct dir* dir_open(struct inode* inode)
 {
-	//lock_acquire(&dir_lock);
 	struct dir* dir = calloc(1, sizeof *dir);
 	if (inode != NULL && dir != NULL) {
 		dir->inode = inode;
 		dir->pos = 0;
-	//	lock_release(&dir_lock);
+		dir->index = NULL;
 		return dir;
 	}
 	else {
 		inode_close(inode);
 		free(dir);
-		//lock_release(&dir_lock);
 		return NULL;
 	}
 }
@@ -75,12 +116,15 @@ struct dir* dir_reopen(struct dir* dir)
 /* Destroys DIR and frees associated resources. */
 void dir_close(struct dir* dir)
 {
-	// lock_acquire(&dir_lock);
 	if (dir != NULL) {
+		if (dir->index != NULL) {
+			rwlock_acquire_write(&dir_lock);
+			index_put(dir->index);
+			rwlock_release_write(&dir_lock);
+		}
 		inode_close(dir->inode);
 		free(dir);
 	}
-	// lock_release(&dir_lock);
 }
 
 /* Returns the inode encapsulated by DIR. */
@@ -89,13 +133,154 @@ struct inode* dir_get_inode(struct dir* dir)
 	return dir->inode;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Returns a hash value for the dir_index that contains E. */
+static unsigned index_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+	return hash_int(hash_entry(e, struct dir_index, elem)->sector);
+}
+
+/* Returns true if index A's sector precedes index B's. */
+static bool index_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+	return hash_entry(a, struct dir_index, elem)->sector
+		 < hash_entry(b, struct dir_index, elem)->sector;
+}
+
+/* Returns a hash value for the name in the dir_slot that contains
+	E. */
+static unsigned slot_hash(const struct hash_elem* e, void* aux UNUSED)
+{
+	return hash_string(hash_entry(e, struct dir_slot, elem.hash_elem)->name);
+}
+
+/* Returns true if slot A's name precedes slot B's. */
+static bool slot_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED)
+{
+	return strcmp(hash_entry(a, struct dir_slot, elem.hash_elem)->name,
+					  hash_entry(b, struct dir_slot, elem.hash_elem)->name)
+		 < 0;
+}
+
+/* Frees the dir_slot that contains E. */
+static void slot_free(struct hash_elem* e, void* aux UNUSED)
+{
+	free(hash_entry(e, struct dir_slot, elem.hash_elem));
+}
+
+/* Frees every slot in INDEX and marks it unbuilt. */
+static void index_clear(struct dir_index* index)
+{
+	hash_clear(&index->names, slot_free);
+	while (!list_empty(&index->free_slots))
+		free(list_entry(list_pop_front(&index->free_slots), struct dir_slot, elem.list_elem));
+	index->built = false;
+}
+
+/* Fills in INDEX from the entries in directory INODE.  Returns
+	true if successful, false if memory ran out. */
+static bool index_build(struct dir_index* index, struct inode* inode)
+{
+	struct dir_entry e;
+	off_t ofs;
+
+	for (ofs = 0; inode_read_at(inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e) {
+		struct dir_slot* slot = malloc(sizeof *slot);
+		if (slot == NULL) {
+			index_clear(index);
+			return false;
+		}
+
+		slot->ofs = ofs;
+		if (e.in_use) {
+			slot->inode_sector = e.inode_sector;
+			strlcpy(slot->name, e.name, sizeof slot->name);
+			/* lookup() used to return the first of several entries
+				with the same name, so ignore the rest. */
+			if (hash_insert(&index->names, &slot->elem.hash_elem) != NULL)
+				free(slot);
+		}
+		else
+			list_push_back(&index->free_slots, &slot->elem.list_elem);
+	}
+	index->end = ofs;
+	index->built = true;
+	return true;
+}
+
+/* Returns DIR's index, attaching DIR to the index for its inode
+	and building it if necessary.  Returns a null pointer if memory
+	ran out, in which case the caller must fall back to scanning
+	the directory.  DIR_LOCK must be held for writing. */
+static struct dir_index* index_get(struct dir* dir)
+{
+	struct dir_index* index = dir->index;
+
+	if (index == NULL) {
+		struct dir_index key;
+		struct hash_elem* e;
+
+		key.sector = inode_get_inumber(dir->inode);
+		e = hash_find(&dir_indexes, &key.elem);
+		if (e != NULL)
+			index = hash_entry(e, struct dir_index, elem);
+		else {
+			index = malloc(sizeof *index);
+			if (index == NULL)
+				return NULL;
+			if (!hash_init(&index->names, slot_hash, slot_less, NULL)) {
+				free(index);
+				return NULL;
+			}
+			index->sector = key.sector;
+			index->open_cnt = 0;
+			index->built = false;
+			list_init(&index->free_slots);
+			index->end = 0;
+			hash_insert(&dir_indexes, &index->elem);
+		}
+		index->open_cnt++;
+		dir->index = index;
+	}
+
+	if (!index->built && !index_build(index, dir->inode))
+		return NULL;
+	return index;
+}
+
+/* Detaches a struct dir from INDEX, destroying INDEX if it was
+	the last one.  DIR_LOCK must be held for writing. */
+static void index_put(struct dir_index* index)
+{
+	if (--index->open_cnt == 0) {
+		hash_delete(&dir_indexes, &index->elem);
+		index_clear(index);
+		hash_destroy(&index->names, NULL);
+		free(index);
+	}
+}
+
+/* Returns the slot in INDEX for the entry named NAME, or a null
+	pointer if there is none. */
+static struct dir_slot* index_find(struct dir_index* index, const char* name)
+{
+	struct dir_slot key;
+	struct hash_elem* e;
+
+	if (strlen(name) > NAME_MAX)
+		return NULL;
+	strlcpy(key.name, name, sizeof key.name);
+	e = hash_find(&index->names, &key.elem.hash_elem);
+	return e != NULL ? hash_entry(e, struct dir_slot, elem.hash_elem) : NULL;
+}
+
+/* Searches DIR for a file with the given NAME, using INDEX if it
+	is non-null and scanning the directory otherwise.
 	If successful, returns true, sets *EP to the directory entry
 	if EP is non-null, and sets *OFSP to the byte offset of the
 	directory entry if OFSP is non-null.
 	otherwise, returns false and ignores EP and OFSP. */
-static bool
-	 lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp)
+static bool lookup(
+	 const struct dir* dir, struct dir_index* index, const char* name, struct dir_entry* ep, off_t* ofsp)
 {
 	struct dir_entry e;
 	size_t ofs;
@@ -103,6 +288,20 @@ static bool
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
 
+	if (index != NULL) {
+		struct dir_slot* slot = index_find(index, name);
+		if (slot == NULL)
+			return false;
+		if (ep != NULL) {
+			ep->inode_sector = slot->inode_sector;
+			strlcpy(ep->name, slot->name, sizeof ep->name);
+			ep->in_use = true;
+		}
+		if (ofsp != NULL)
+			*ofsp = slot->ofs;
+		return true;
+	}
+
 	for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
 		  ofs += sizeof e)
 		if (e.in_use && !strcmp(name, e.name)) {
@@ -118,20 +317,39 @@ static bool
 /* Searches DIR for a file with the given NAME
 	and returns true if one exists, false otherwise.
 	On success, sets *INODE to an inode for the file, otherwise to
-	a null pointer.  The caller must close *INODE. */
-bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode)
+	a null pointer.  The caller must close *INODE.
+	Consults the dentry cache first and records the result there. */
+bool dir_lookup(struct dir* dir, const char* name, struct inode** inode)
 {
+	struct dir_index* index;
+	block_sector_t parent, sector;
 	struct dir_entry e;
 
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
 
-	//lock_acquire(&dir_lock);
-	if (lookup(dir, name, &e, NULL))
-		*inode = inode_open(e.inode_sector);
-	else
-		*inode = NULL;
-	//lock_release(&dir_lock);
+	/* Attaching DIR to its index and building the index change
+		it, so they need DIR_LOCK for writing.  This happens about
+		once per struct dir.  Another thread may do it while we
+		switch locks, so check again once we hold the lock for
+		writing.  If it fails, we scan the directory. */
+	rwlock_acquire_read(&dir_lock);
+	if (dir->index == NULL || !dir->index->built) {
+		rwlock_release_read(&dir_lock);
+		rwlock_acquire_write(&dir_lock);
+		if (dir->index == NULL || !dir->index->built)
+			index_get(dir);
+		rwlock_release_write(&dir_lock);
+		rwlock_acquire_read(&dir_lock);
+	}
+	index = dir->index != NULL && dir->index->built ? dir->index : NULL;
+	parent = inode_get_inumber(dir->inode);
+	if (!dcache_lookup(parent, name, &sector)) {
+		sector = lookup(dir, index, name, &e, NULL) ? e.inode_sector : 0;
+		dcache_insert(parent, name, sector);
+	}
+	*inode = sector != 0 ? inode_open(sector) : NULL;
+	rwlock_release_read(&dir_lock);
 
 	return *inode != NULL;
 }
@@ -144,42 +362,79 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode)
 	error occurs. */
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector)
 {
+	struct dir_index* index;
+	struct dir_slot* slot = NULL;
 	struct dir_entry e;
 	off_t ofs;
 	bool success = false;
 	
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
-	
-	lock_acquire(&dir_lock);
+
 	/* Check NAME for validity. */
 	if (*name == '\0' || strlen(name) > NAME_MAX)
 		return false;
 
+	rwlock_acquire_write(&dir_lock);
+	index = index_get(dir);
+
 	/* Check that NAME is not in use. */
-	if (lookup(dir, name, NULL, NULL))
+	if (lookup(dir, index, name, NULL, NULL))
 		goto done;
 
 	/* Set OFS to offset of free slot.
 		If there are no free slots, then it will be set to the
-		current end-of-file.
-
-		inode_read_at() will only return a short read at end of file.
-		Otherwise, we'd need to verify that we didn't get a short
-		read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-		  ofs += sizeof e)
-		if (!e.in_use)
-			break;
+		current end-of-file. */
+	if (index != NULL) {
+		if (!list_empty(&index->free_slots))
+			slot = list_entry(list_pop_front(&index->free_slots), struct dir_slot, elem.list_elem);
+		else {
+			slot = malloc(sizeof *slot);
+			if (slot == NULL)
+				goto done;
+			slot->ofs = index->end;
+		}
+		ofs = slot->ofs;
+	}
+	else {
+		/* inode_read_at() will only return a short read at end of
+			file.  Otherwise, we'd need to verify that we didn't get a
+			short read due to something intermittent such as low
+			memory. */
+		for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+			  ofs += sizeof e)
+			if (!e.in_use)
+				break;
+	}
 
 	/* Write slot. */
+	memset(&e, 0, sizeof e);
 	e.in_use = true;
 	strlcpy(e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success)
+		dcache_invalidate(inode_get_inumber(dir->inode), name);
+
+	/* Record the new entry in the index. */
+	if (slot != NULL) {
+		bool appended = slot->ofs == index->end;
+
+		if (success) {
+			slot->inode_sector = inode_sector;
+			strlcpy(slot->name, name, sizeof slot->name);
+			hash_insert(&index->names, &slot->elem.hash_elem);
+			if (appended)
+				index->end += sizeof e;
+		}
+		else if (appended)
+			free(slot);
+		else
+			list_push_front(&index->free_slots, &slot->elem.list_elem);
+	}
 
 done:
-	lock_release(&dir_lock);
+	rwlock_release_write(&dir_lock);
 	return success;
 }
 
@@ -188,6 +443,7 @@ done:
 	which occurs only if there is no file with the given NAME. */
 bool dir_remove(struct dir* dir, const char* name)
 {
+	struct dir_index* index;
 	struct dir_entry e;
 	struct inode* inode = NULL;
 	bool success = false;
@@ -195,9 +451,11 @@ bool dir_remove(struct dir* dir, const char* name)
 
 	ASSERT(dir != NULL);
 	ASSERT(name != NULL);
-	lock_acquire(&dir_lock);
+	rwlock_acquire_write(&dir_lock);
+	index = index_get(dir);
+
 	/* Find directory entry. */
-	if (!lookup(dir, name, &e, &ofs))
+	if (!lookup(dir, index, name, &e, &ofs))
 		goto done;
 
 	/* Open inode. */
@@ -209,6 +467,14 @@ bool dir_remove(struct dir* dir, const char* name)
 	e.in_use = false;
 	if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
 		goto done;
+	dcache_invalidate(inode_get_inumber(dir->inode), name);
+
+	/* Move its slot to the free list. */
+	if (index != NULL) {
+		struct dir_slot* slot = index_find(index, name);
+		hash_delete(&index->names, &slot->elem.hash_elem);
+		list_push_back(&index->free_slots, &slot->elem.list_elem);
+	}
 
 	/* Remove inode. */
 	inode_remove(inode);
@@ -216,7 +482,7 @@ bool dir_remove(struct dir* dir, const char* name)
 
 done:
 	inode_close(inode);
-	lock_release(&dir_lock);
+	rwlock_release_write(&dir_lock);
 	return success;
 }
 
@@ -226,7 +492,6 @@ done:
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1])
 {
 	struct dir_entry e;
-	//lock_acquire(&dir_lock);
 	while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
 		dir->pos += sizeof e;
 		if (e.in_use) {
@@ -234,6 +499,5 @@ bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1])
 			return true;
 		}
 	}
-	//lock_release(&dir_lock);
 	return false;
 }
@@ -5,6 +5,11 @@
 #include "threads/synch.h"
 #include <debug.h>
 
+/* Bounds on the read-ahead window, in sectors. */
+#define READ_AHEAD_MIN 2
+#define READ_AHEAD_MAX 32
+
+static void file_read_ahead(struct file *, off_t pos, off_t bytes_read);
 
 /* Opens a file for the given INODE, of which it takes ownership,
 	and returns the new file.  Returns a null pointer if an
@@ -17,6 +22,9 @@ struct file *file_open(struct inode *inode)
 	{
 		file->inode = inode;
 		file->pos = 0;
+		file->ra_next = 0;
+		file->ra_end = 0;
+		file->ra_window = 0;
 		return file;
 	}
 	else
@@ -58,10 +66,45 @@ struct inode *file_get_inode(struct file *file)
 off_t file_read(struct file *file, void *buffer, off_t size)
 {
 	off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+	file_read_ahead(file, file->pos, bytes_read);
 	file->pos += bytes_read;
 	return bytes_read;
 }
 
+/* Updates FILE's read-ahead state after reading BYTES_READ bytes
+	at POS.  A read that starts where the previous one ended is
+	sequential and doubles the window, up to READ_AHEAD_MAX
+	sectors; any other read collapses it.  While the window is
+	open, the sectors it covers beyond POS are queued for
+	read-ahead. */
+static void file_read_ahead(struct file *file, off_t pos, off_t bytes_read)
+{
+	off_t start, end;
+
+	if (pos != file->ra_next)
+	{
+		file->ra_window = 0;
+		file->ra_end = 0;
+	}
+	else if (file->ra_window == 0)
+		file->ra_window = READ_AHEAD_MIN;
+	else if (file->ra_window < READ_AHEAD_MAX)
+		file->ra_window *= 2;
+	file->ra_next = pos + bytes_read;
+
+	if (file->ra_window == 0 || bytes_read == 0)
+		return;
+
+	/* Only queue what earlier calls haven't. */
+	start = file->ra_next > file->ra_end ? file->ra_next : file->ra_end;
+	end = file->ra_next + file->ra_window * BLOCK_SECTOR_SIZE;
+	if (start < end)
+	{
+		inode_read_ahead(file->inode, start, end - start);
+		file->ra_end = end;
+	}
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
 	starting at offset FILE_OFS in the file.
 	Returns the number of bytes actually read,
@@ -75,10 +118,9 @@ off_t file_read_at(struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
 	starting at the file's current position.
 	Returns the number of bytes actually written,
-	which may be less than SIZE if end of file is reached.
-	(Normally we'd grow the file in that case, but file growth is
-	not yet implemented.)
-	Advances FILE's position by the number of bytes read. */
+	which may be less than SIZE if the disk fills up.
+	Writing past end of file grows the file.
+	Advances FILE's position by the number of bytes written. */
 off_t file_write(struct file *file, const void *buffer, off_t size)
 {
 	off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
@@ -89,15 +131,38 @@ off_t file_write(struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
 	starting at offset FILE_OFS in the file.
 	Returns the number of bytes actually written,
-	which may be less than SIZE if end of file is reached.
-	(Normally we'd grow the file in that case, but file growth is
-	not yet implemented.)
+	which may be less than SIZE if the disk fills up.
+	Writing past end of file grows the file.
 	The file's current position is unaffected. */
 off_t file_write_at(struct file *file, const void *buffer, off_t size, off_t file_ofs)
 {
 	return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
+/* Reads from FILE, starting at the file's current position, into
+	the CNT buffers in IOV, filling each in turn.  Returns the
+	total number of bytes read, which is short if end of file is
+	reached.  Advances FILE's position by the number of bytes
+	read. */
+off_t file_readv(struct file *file, const struct iovec *iov, size_t cnt)
+{
+	off_t bytes_read = inode_readv_at(file->inode, iov, cnt, file->pos);
+	file_read_ahead(file, file->pos, bytes_read);
+	file->pos += bytes_read;
+	return bytes_read;
+}
+
+/* Writes the CNT buffers in IOV one after another into FILE,
+	starting at the file's current position.  Returns the total
+	number of bytes written, which is short if the disk fills up.
+	Advances FILE's position by the number of bytes written. */
+off_t file_writev(struct file *file, const struct iovec *iov, size_t cnt)
+{
+	off_t bytes_written = inode_writev_at(file->inode, iov, cnt, file->pos);
+	file->pos += bytes_written;
+	return bytes_written;
+}
+
 /* Returns the size of FILE in bytes. */
 off_t file_length(struct file *file)
 {
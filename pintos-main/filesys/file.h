@@ -10,6 +10,11 @@ struct file
 {
 	struct inode *inode; /* File's inode. */
 	off_t pos;			 /* Current position. */
+
+	/* Sequential read detection. */
+	off_t ra_next;		 /* Where a sequential read would start. */
+	off_t ra_end;		 /* End of the data already queued for read-ahead. */
+	off_t ra_window;	 /* Read-ahead window in sectors, 0 if random. */
 };
 
 /* Opening and closing files. */
@@ -23,6 +28,8 @@ off_t file_read(struct file*, void*, off_t);
 off_t file_read_at(struct file*, void*, off_t size, off_t start);
 off_t file_write(struct file*, const void*, off_t);
 off_t file_write_at(struct file*, const void*, off_t size, off_t start);
+off_t file_readv(struct file*, const struct iovec*, size_t cnt);
+off_t file_writev(struct file*, const struct iovec*, size_t cnt);
 
 /* File position. */
 void file_seek(struct file*, off_t);
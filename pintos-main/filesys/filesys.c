@@ -1,5 +1,6 @@
 #include "filesys/filesys.h"
 
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
@@ -12,6 +13,10 @@
 /* Partition that contains the file system. */
 struct block* fs_device;
 
+/* Root directory, kept open so that its inode and name index stay
+	in memory. */
+static struct dir* root_dir;
+
 static void do_format(void);
 
 /* Initializes the file system module.
@@ -22,6 +27,7 @@ void filesys_init(bool format)
 	if (fs_device == NULL)
 		PANIC("No file system device found, can't initialize file system.");
 
+	cache_init();
 	inode_init();
 	free_map_init();
 	dir_init();
@@ -30,13 +36,19 @@ void filesys_init(bool format)
 		do_format();
 
 	free_map_open();
+
+	root_dir = dir_open_root();
+	if (root_dir == NULL)
+		PANIC("can't open root directory");
 }
 
 /* Shuts down the file system module, writing any unwritten data
 	to disk. */
 void filesys_done(void)
 {
+	dir_close(root_dir);
 	free_map_close();
+	cache_flush();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -45,15 +57,15 @@ void filesys_done(void)
 	or if internal memory allocation fails. */
 bool filesys_create(const char* name, off_t initial_size)
 {
+	block_sector_t dir_sector = inode_get_inumber(dir_get_inode(root_dir));
 	block_sector_t inode_sector = 0;
-	struct dir* dir = dir_open_root();
 	bool success
-		 = (dir != NULL && free_map_allocate(1, &inode_sector)
-			 && inode_create(inode_sector, initial_size)
-			 && dir_add(dir, name, inode_sector));
-	if (!success && inode_sector != 0)
+		 = (free_map_allocate_near(dir_sector, 1, &inode_sector)
+			 && inode_create(inode_sector, initial_size) && dir_add(root_dir, name, inode_sector));
+	if (!success && inode_sector != 0) {
 		free_map_release(inode_sector, 1);
-	dir_close(dir);
+		free_map_flush();
+	}
 
 	return success;
 }
@@ -65,14 +77,9 @@ bool filesys_create(const char* name, off_t initial_size)
 	or if an internal memory allocation fails. */
 struct file* filesys_open(const char* name)
 {
-	
-	struct dir* dir = dir_open_root();
 	struct inode* inode = NULL;
 
-	if (dir != NULL)
-		dir_lookup(dir, name, &inode);
-	dir_close(dir);
-
+	dir_lookup(root_dir, name, &inode);
 	return file_open(inode);
 }
 
@@ -82,12 +89,7 @@ struct file* filesys_open(const char* name)
 	or if an internal memory allocation fails. */
 bool filesys_remove(const char* name)
 {
-
-	struct dir* dir = dir_open_root();
-	bool success = dir != NULL && dir_remove(dir, name);
-	dir_close(dir);
-
-	return success;
+	return dir_remove(root_dir, name);
 }
 
 /* Formats the file system. */
@@ -98,5 +100,6 @@ static void do_format(void)
 	if (!dir_create(ROOT_DIR_SECTOR, 16))
 		PANIC("root directory creation failed");
 	free_map_close();
+	cache_flush();
 	printf("done.\n");
 }
@@ -3,16 +3,46 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <string.h>
 
 
 struct lock free_map_lock;
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;	  /* Free map, one bit per sector. */
 
+/* Sectors of the free map file whose contents have changed since
+	they were last written, one bit per sector.  Changes are
+	batched here until free_map_flush(). */
+static struct bitmap* dirty_sectors;
+
+/* Number of free map bits stored in one sector of its file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+/* A maximal run of free sectors. */
+struct extent {
+	block_sector_t start; /* First free sector. */
+	block_sector_t cnt;	 /* Number of free sectors. */
+};
+
+/* Index of the free map's free extents, sorted by starting
+	sector, so that allocation looks at runs of free sectors
+	instead of individual bits.  Rebuilt from FREE_MAP whenever the
+	free map is read and kept in step with it afterward. */
+static struct extent* extents;
+static size_t extent_cnt; /* Number of extents in use. */
+static size_t extent_cap; /* Number of extents allocated. */
+
+static void mark_dirty(block_sector_t, size_t cnt);
+static void build_extents(void);
+static void take_sectors(size_t i, block_sector_t, size_t cnt);
+static void give_sectors(block_sector_t, size_t cnt);
+
 /* Initializes the free map. */
 void free_map_init(void)
 {
@@ -20,40 +50,263 @@ void free_map_init(void)
 	free_map = bitmap_create(block_size(fs_device));
 	if (free_map == NULL)
 		PANIC("bitmap creation failed--file system device is too large");
+	dirty_sectors = bitmap_create(DIV_ROUND_UP(bitmap_size(free_map), BITS_PER_SECTOR));
+	if (dirty_sectors == NULL)
+		PANIC("bitmap creation failed--file system device is too large");
 	bitmap_mark(free_map, FREE_MAP_SECTOR);
 	bitmap_mark(free_map, ROOT_DIR_SECTOR);
+	build_extents();
+}
+
+/* Marks the CNT sectors starting at SECTOR, which lie within
+	extent I, as allocated, and stores SECTOR into *SECTORP.
+	FREE_MAP_LOCK must be held. */
+static void allocate_from(size_t i, block_sector_t sector, size_t cnt, block_sector_t* sectorp)
+{
+	take_sectors(i, sector, cnt);
+	bitmap_set_multiple(free_map, sector, cnt, true);
+	mark_dirty(sector, cnt);
+	*sectorp = sector;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-	the first into *SECTORP.
+	the first into *SECTORP.  Takes them from the smallest run of
+	free sectors that is big enough, to leave large runs for large
+	requests.
 	Returns true if successful, false if not enough consecutive
-	sectors were available or if the free_map file could not be
-	written. */
+	sectors were available.
+	The change reaches the free map file at the next
+	free_map_flush(). */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp)
 {
+	size_t best = extent_cnt;
+	size_t i;
+
+	ASSERT(cnt > 0);
+
+	lock_acquire(&free_map_lock);
+	for (i = 0; i < extent_cnt; i++)
+		if (extents[i].cnt >= cnt && (best == extent_cnt || extents[i].cnt < extents[best].cnt)) {
+			best = i;
+			if (extents[i].cnt == cnt)
+				break;
+		}
+	if (best < extent_cnt)
+		allocate_from(best, extents[best].start, cnt, sectorp);
+	lock_release(&free_map_lock);
+	return best < extent_cnt;
+}
+
+/* Allocates CNT consecutive sectors from the free map as close as
+	possible to sector HINT and stores the first into *SECTORP.
+	If HINT itself starts a big enough run of free sectors, the
+	allocation starts there, so that passing the sector just after
+	a file's last block keeps the file contiguous.
+	Returns true if successful, false if not enough consecutive
+	sectors were available.
+	The change reaches the free map file at the next
+	free_map_flush(). */
+bool free_map_allocate_near(block_sector_t hint, size_t cnt, block_sector_t* sectorp)
+{
+	size_t lo = 0, hi = extent_cnt;
+	size_t after, before;
+	bool found = true;
+
+	ASSERT(cnt > 0);
+
 	lock_acquire(&free_map_lock);
-	block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR && free_map_file != NULL
-		 && !bitmap_write(free_map, free_map_file)) {
-		bitmap_set_multiple(free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+
+	/* Find the first extent that starts after HINT. */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (extents[mid].start <= hint)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	if (sector != BITMAP_ERROR)
-		*sectorp = sector;
+
+	/* Use HINT itself if the extent before it has room there. */
+	if (lo > 0 && hint - extents[lo - 1].start + cnt <= extents[lo - 1].cnt) {
+		allocate_from(lo - 1, hint, cnt, sectorp);
+		lock_release(&free_map_lock);
+		return true;
+	}
+
+	/* Otherwise look for the nearest big enough extent in each
+		direction and take the closer one: the start of an extent
+		after HINT, or the end of one before it. */
+	for (after = lo; after < extent_cnt && extents[after].cnt < cnt; after++)
+		continue;
+	for (before = lo; before > 0 && extents[before - 1].cnt < cnt; before--)
+		continue;
+	if (after < extent_cnt
+		 && (before == 0
+			  || extents[after].start - hint
+						<= hint - (extents[before - 1].start + extents[before - 1].cnt - cnt)))
+		allocate_from(after, extents[after].start, cnt, sectorp);
+	else if (before > 0)
+		allocate_from(
+			 before - 1, extents[before - 1].start + extents[before - 1].cnt - cnt, cnt, sectorp);
+	else
+		found = false;
+
 	lock_release(&free_map_lock);
-	return sector != BITMAP_ERROR;
+	return found;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.
+	The change reaches the free map file at the next
+	free_map_flush(). */
 void free_map_release(block_sector_t sector, size_t cnt)
 {
 	lock_acquire(&free_map_lock);
 	ASSERT(bitmap_all(free_map, sector, cnt));
 	bitmap_set_multiple(free_map, sector, cnt, false);
-	bitmap_write(free_map, free_map_file);
+	give_sectors(sector, cnt);
+	mark_dirty(sector, cnt);
+	lock_release(&free_map_lock);
+}
+
+/* Writes the sectors of the free map file that have changed
+	since the last flush.  Does nothing before the free map file
+	has been opened or created.  All of the file's sectors are
+	allocated by then, so writing it never allocates and never
+	calls back into the free map. */
+void free_map_flush(void)
+{
+	size_t i = 0;
+
+	lock_acquire(&free_map_lock);
+	if (free_map_file != NULL) {
+		while ((i = bitmap_scan(dirty_sectors, i, 1, true)) != BITMAP_ERROR) {
+			size_t start = i * BITS_PER_SECTOR;
+			size_t cnt = bitmap_size(free_map) - start;
+			if (cnt > BITS_PER_SECTOR)
+				cnt = BITS_PER_SECTOR;
+			if (!bitmap_write_range(free_map, free_map_file, start, cnt))
+				PANIC("can't write free map");
+			bitmap_reset(dirty_sectors, i);
+		}
+	}
 	lock_release(&free_map_lock);
 }
 
+/* Records that the free map file sectors holding the bits for CNT
+	sectors starting at SECTOR need to be written. */
+static void mark_dirty(block_sector_t sector, size_t cnt)
+{
+	size_t first, last;
+
+	if (cnt == 0)
+		return;
+	first = sector / BITS_PER_SECTOR;
+	last = (sector + cnt - 1) / BITS_PER_SECTOR;
+	bitmap_set_multiple(dirty_sectors, first, last - first + 1, true);
+}
+
+/* Makes room for at least one more extent in EXTENTS.  Panics if
+	memory is exhausted, because the free map can't be kept
+	accurate without it. */
+static void reserve_extent(void)
+{
+	if (extent_cnt == extent_cap) {
+		size_t new_cap = extent_cap > 0 ? extent_cap * 2 : 32;
+		struct extent* new_extents = realloc(extents, new_cap * sizeof *extents);
+		if (new_extents == NULL)
+			PANIC("out of memory for free extent index");
+		extents = new_extents;
+		extent_cap = new_cap;
+	}
+}
+
+/* Inserts an extent of CNT sectors starting at START at position
+	I in EXTENTS. */
+static void insert_extent(size_t i, block_sector_t start, block_sector_t cnt)
+{
+	reserve_extent();
+	memmove(extents + i + 1, extents + i, (extent_cnt - i) * sizeof *extents);
+	extents[i].start = start;
+	extents[i].cnt = cnt;
+	extent_cnt++;
+}
+
+/* Removes the extent at position I in EXTENTS. */
+static void remove_extent(size_t i)
+{
+	memmove(extents + i, extents + i + 1, (extent_cnt - i - 1) * sizeof *extents);
+	extent_cnt--;
+}
+
+/* Rebuilds EXTENTS from FREE_MAP. */
+static void build_extents(void)
+{
+	size_t size = bitmap_size(free_map);
+	size_t start = 0;
+
+	extent_cnt = 0;
+	while ((start = bitmap_scan(free_map, start, 1, false)) != BITMAP_ERROR) {
+		size_t end = bitmap_scan(free_map, start, 1, true);
+		if (end == BITMAP_ERROR)
+			end = size;
+		insert_extent(extent_cnt, start, end - start);
+		start = end;
+	}
+}
+
+/* Removes the CNT sectors starting at SECTOR, which must lie
+	within extent I, from EXTENTS. */
+static void take_sectors(size_t i, block_sector_t sector, size_t cnt)
+{
+	struct extent* e = &extents[i];
+	block_sector_t end = e->start + e->cnt;
+
+	ASSERT(sector >= e->start && sector + cnt <= end);
+
+	if (sector == e->start && cnt == e->cnt)
+		remove_extent(i);
+	else if (sector == e->start) {
+		e->start += cnt;
+		e->cnt -= cnt;
+	}
+	else if (sector + cnt == end)
+		e->cnt -= cnt;
+	else {
+		e->cnt = sector - e->start;
+		insert_extent(i + 1, sector + cnt, end - (sector + cnt));
+	}
+}
+
+/* Adds the CNT sectors starting at SECTOR to EXTENTS, merging
+	them with the extents on either side if they touch. */
+static void give_sectors(block_sector_t sector, size_t cnt)
+{
+	size_t lo = 0, hi = extent_cnt;
+	bool join_prev, join_next;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (extents[mid].start < sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	join_prev = lo > 0 && extents[lo - 1].start + extents[lo - 1].cnt == sector;
+	join_next = lo < extent_cnt && extents[lo].start == sector + cnt;
+	if (join_prev && join_next) {
+		extents[lo - 1].cnt += cnt + extents[lo].cnt;
+		remove_extent(lo);
+	}
+	else if (join_prev)
+		extents[lo - 1].cnt += cnt;
+	else if (join_next) {
+		extents[lo].start = sector;
+		extents[lo].cnt += cnt;
+	}
+	else
+		insert_extent(lo, sector, cnt);
+}
+
 /* Opens the free map file and reads it from disk. */
 void free_map_open(void)
 {
@@ -62,26 +315,44 @@ void free_map_open(void)
 		PANIC("can't open free map");
 	if (!bitmap_read(free_map, free_map_file))
 		PANIC("can't read free map");
+	lock_acquire(&free_map_lock);
+	build_extents();
+	lock_release(&free_map_lock);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void free_map_close(void)
 {
+	free_map_flush();
 	file_close(free_map_file);
+	free_map_file = NULL;
 }
 
 /* Creates a new free map file on disk and writes the free map to
 	it. */
 void free_map_create(void)
 {
+	struct file* file;
+
 	/* Create inode. */
 	if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map)))
 		PANIC("free map creation failed");
 
-	/* Write bitmap to file. */
-	free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
-	if (free_map_file == NULL)
+	/* Write bitmap to file.  The file starts out as a hole, so this
+		allocates its data sectors, which calls free_map_flush()
+		from inside the write.  FREE_MAP_FILE stays null until the
+		write is done, so that flush does nothing instead of writing
+		the file again under the same inode lock. */
+	file = file_open(inode_open(FREE_MAP_SECTOR));
+	if (file == NULL)
 		PANIC("can't open free map");
-	if (!bitmap_write(free_map, free_map_file))
+	if (!bitmap_write(free_map, file))
 		PANIC("can't write free map");
+
+	/* The write may have copied out parts of the bitmap before the
+		allocations that changed them.  Every data sector of the
+		file now exists, so writing those parts again allocates
+		nothing. */
+	free_map_file = file;
+	free_map_flush();
 }
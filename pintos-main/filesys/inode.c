@@ -1,11 +1,12 @@
 #include "filesys/inode.h"
 
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 
-struct lock filesys_lock; // LOCK EVERYTHING, BAD!!!
+#include <string.h>
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -17,39 +18,200 @@ static inline size_t bytes_to_sectors(off_t size)
 	return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE);
 }
 
+/* Largest number of sectors an inode can address. */
+#define INODE_MAX_SECTORS \
+	(INODE_DIRECT_CNT + INODE_INDIRECT_CNT + INODE_INDIRECT_CNT * INODE_INDIRECT_CNT)
+
+/* Allocates a sector as close as possible to *HINT, fills it
+	with zeros, stores its number in *SECTORP, and advances *HINT
+	past it.  Returns true if successful, false if the disk is
+	full. */
+static bool allocate_zeroed(block_sector_t *sectorp, block_sector_t *hint)
+{
+	static char zeros[BLOCK_SECTOR_SIZE];
+
+	if (!free_map_allocate_near(*hint, 1, sectorp))
+		return false;
+	cache_write(*sectorp, zeros);
+	*hint = *sectorp + 1;
+	return true;
+}
+
+/* Returns the sector stored in *SLOT, a pointer inside an
+	in-memory inode_disk.  If the slot is empty and HINT is
+	non-null, allocates a zeroed sector near *HINT for it first.
+	Returns 0 if the slot is empty and can't or shouldn't be
+	filled. */
+static block_sector_t slot_get(block_sector_t *slot, block_sector_t *hint)
+{
+	if (*slot == 0 && hint != NULL)
+		allocate_zeroed(slot, hint);
+	return *slot;
+}
+
+/* Like slot_get(), but for entry IDX of the indirect block in
+	sector INDEX. */
+static block_sector_t index_get(block_sector_t index, size_t idx, block_sector_t *hint)
+{
+	block_sector_t sector;
+	size_t ofs = idx * sizeof sector;
+
+	cache_read_at(index, &sector, sizeof sector, ofs);
+	if (sector == 0 && hint != NULL && allocate_zeroed(&sector, hint))
+		cache_write_at(index, &sector, sizeof sector, ofs);
+	return sector;
+}
+
+/* Returns the device sector that holds data sector IDX of the
+	file described by DISK_INODE, or 0 if it has not been
+	allocated, that is, if it is a hole that reads as zeros.
+	If HINT is non-null, allocates the data sector and any
+	indirect blocks leading to it that are missing, as close to
+	*HINT as possible; DISK_INODE may then be modified and the
+	caller must write it back.  Returns 0 if allocation fails. */
+static block_sector_t index_to_sector(
+	 struct inode_disk *disk_inode, size_t idx, block_sector_t *hint)
+{
+	block_sector_t index;
+
+	if (idx < INODE_DIRECT_CNT)
+		return slot_get(&disk_inode->direct[idx], hint);
+	idx -= INODE_DIRECT_CNT;
+
+	if (idx < INODE_INDIRECT_CNT)
+	{
+		index = slot_get(&disk_inode->indirect, hint);
+		return index != 0 ? index_get(index, idx, hint) : 0;
+	}
+	idx -= INODE_INDIRECT_CNT;
+
+	if (idx < INODE_INDIRECT_CNT * INODE_INDIRECT_CNT)
+	{
+		index = slot_get(&disk_inode->doubly_indirect, hint);
+		if (index != 0)
+			index = index_get(index, idx / INODE_INDIRECT_CNT, hint);
+		return index != 0 ? index_get(index, idx % INODE_INDIRECT_CNT, hint) : 0;
+	}
+	return 0;
+}
+
 /* Returns the block device sector that contains byte offset POS
-	within INODE.
+	within INODE, or 0 if POS lies in a hole.
 	Returns -1 if INODE does not contain data for a byte at offset
 	POS. */
-static block_sector_t byte_to_sector(const struct inode *inode, off_t pos)
+static block_sector_t byte_to_sector(struct inode *inode, off_t pos)
 {
 	ASSERT(inode != NULL);
 	if (pos < inode->data.length)
-		return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+		return index_to_sector(&inode->data, pos / BLOCK_SECTOR_SIZE, NULL);
 	else
 		return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-	returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns true if a file LENGTH bytes long fits in an inode. */
+static bool length_ok(off_t length)
+{
+	return bytes_to_sectors(length) <= INODE_MAX_SECTORS;
+}
+
+/* Releases the indirect block in sector INDEX and, if LEVEL is
+	greater than 1, everything it points to, recursively.  LEVEL
+	is 1 for an indirect block and 2 for a doubly indirect one. */
+static void release_index(block_sector_t index, int level)
+{
+	block_sector_t *sectors = malloc(BLOCK_SECTOR_SIZE);
+	size_t i;
+
+	if (sectors == NULL)
+		PANIC("out of memory releasing inode blocks");
+	cache_read(index, sectors);
+	for (i = 0; i < INODE_INDIRECT_CNT; i++)
+		if (sectors[i] != 0)
+		{
+			if (level > 1)
+				release_index(sectors[i], level - 1);
+			else
+				free_map_release(sectors[i], 1);
+		}
+	free(sectors);
+	free_map_release(index, 1);
+}
+
+/* Releases every data and indirect block of DISK_INODE. */
+static void inode_release_blocks(struct inode_disk *disk_inode)
+{
+	size_t i;
+
+	if (disk_inode->flags & INODE_F_INLINE)
+		return;
+	for (i = 0; i < INODE_DIRECT_CNT; i++)
+		if (disk_inode->direct[i] != 0)
+			free_map_release(disk_inode->direct[i], 1);
+	if (disk_inode->indirect != 0)
+		release_index(disk_inode->indirect, 1);
+	if (disk_inode->doubly_indirect != 0)
+		release_index(disk_inode->doubly_indirect, 2);
+}
+
+/* Open inodes, hashed by sector, so that opening a single inode
+	twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Protects OPEN_INODES and the open_cnt and removed members of
+	every open inode. */
+static struct lock open_inodes_lock;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+static struct inode *inode_reopen_locked(struct inode *);
 
 /* Initializes the inode module. */
 void inode_init(void)
 {
-	list_init(&open_inodes);
-	lock_init(&filesys_lock);
+	if (!hash_init(&open_inodes, inode_hash, inode_less, NULL))
+		PANIC("can't create open inode table");
+	lock_init(&open_inodes_lock);
+}
+
+/* Returns a hash value for the inode that contains E. */
+static unsigned inode_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+	const struct inode *inode = hash_entry(e, struct inode, hash_elem);
+	return hash_int(inode->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool inode_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED)
+{
+	return hash_entry(a, struct inode, hash_elem)->sector
+		 < hash_entry(b, struct inode, hash_elem)->sector;
+}
+
+/* Returns the open inode for SECTOR, with its open count
+	incremented, or a null pointer if SECTOR isn't open.
+	OPEN_INODES_LOCK must be held. */
+static struct inode *find_open_inode(block_sector_t sector)
+{
+	struct inode key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find(&open_inodes, &key.hash_elem);
+	if (e == NULL)
+		return NULL;
+	return inode_reopen_locked(hash_entry(e, struct inode, hash_elem));
 }
 
 /* Initializes an inode with LENGTH bytes of data and
 	writes the new inode to sector SECTOR on the file system
-	device.
+	device.  The data is all zeros, held inline if it fits and as
+	one hole otherwise, so no data sectors are allocated or written
+	until they are first written to.
 	Returns true if successful.
-	Returns false if memory or disk allocation fails. */
+	Returns false if memory allocation fails or LENGTH is too
+	large. */
 bool inode_create(block_sector_t sector, off_t length)
 {
-
-	lock_acquire(&filesys_lock);
 	struct inode_disk *disk_inode = NULL;
 	bool success = false;
 
@@ -59,28 +221,18 @@ bool inode_create(block_sector_t sector, off_t length)
 		one sector in size, and you should fix that. */
 	ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+	if (!length_ok(length))
+		return false;
 	disk_inode = calloc(1, sizeof *disk_inode);
 	if (disk_inode != NULL)
 	{
-		size_t sectors = bytes_to_sectors(length);
 		disk_inode->length = length;
+		disk_inode->flags = length <= (off_t) INODE_INLINE_SIZE ? INODE_F_INLINE : 0;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate(sectors, &disk_inode->start))
-		{
-			block_write(fs_device, sector, disk_inode);
-			if (sectors > 0)
-			{
-				static char zeros[BLOCK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++)
-					block_write(fs_device, disk_inode->start + i, zeros);
-			}
-			success = true;
-		}
+		cache_write(sector, disk_inode);
 		free(disk_inode);
+		success = true;
 	}
-		lock_release(&filesys_lock);
 	return success;
 }
 
@@ -89,37 +241,39 @@ bool inode_create(block_sector_t sector, off_t length)
 	Returns a null pointer if memory allocation fails. */
 struct inode *inode_open(block_sector_t sector)
 {
-	struct list_elem *e;
-	struct inode *inode;
+	struct inode *inode, *open;
+	struct hash_elem *e;
 
-	lock_acquire(&filesys_lock);
-	/* Check whether this inode is already open. */	
-	for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e))
-	{
-		inode = list_entry(e, struct inode, elem);
-		if (inode->sector == sector)
-		{
-			inode_reopen(inode);
-			lock_release(&filesys_lock);
-			return inode;
-		}
-	}
+	/* Check whether this inode is already open. */
+	lock_acquire(&open_inodes_lock);
+	inode = find_open_inode(sector);
+	lock_release(&open_inodes_lock);
+	if (inode != NULL)
+		return inode;
 
 	/* Allocate memory. */
 	inode = malloc(sizeof *inode);
 	if (inode == NULL)
 		return NULL;
 
-	/* Initialize. */
-		list_push_front(&open_inodes, &inode->elem);
-		inode->sector = sector;
-		inode->open_cnt = 1;
-		inode->removed = false;
-		inode->current_readers = 0;
-		sema_init(&inode->readers_lock, 1); // no waiters
-		sema_init(&inode->writers_lock, 1); // no waiters
-		block_read(fs_device, inode->sector, &inode->data);
-	lock_release(&filesys_lock);
+	/* Initialize, reading the disk inode without holding the lock. */
+	inode->sector = sector;
+	inode->open_cnt = 1;
+	inode->removed = false;
+	rwlock_init(&inode->rwlock);
+	cache_read(inode->sector, &inode->data);
+
+	/* Someone else may have opened the same inode meanwhile, in
+		which case we use theirs. */
+	lock_acquire(&open_inodes_lock);
+	e = hash_insert(&open_inodes, &inode->hash_elem);
+	open = e != NULL ? inode_reopen_locked(hash_entry(e, struct inode, hash_elem)) : NULL;
+	lock_release(&open_inodes_lock);
+	if (open != NULL)
+	{
+		free(inode);
+		return open;
+	}
 	return inode;
 }
 
@@ -127,7 +281,19 @@ struct inode *inode_open(block_sector_t sector)
 struct inode *inode_reopen(struct inode *inode)
 {
 	if (inode != NULL)
-		inode->open_cnt++;
+	{
+		lock_acquire(&open_inodes_lock);
+		inode_reopen_locked(inode);
+		lock_release(&open_inodes_lock);
+	}
+	return inode;
+}
+
+/* Reopens and returns INODE.  OPEN_INODES_LOCK must be held. */
+static struct inode *inode_reopen_locked(struct inode *inode)
+{
+	ASSERT(lock_held_by_current_thread(&open_inodes_lock));
+	inode->open_cnt++;
 	return inode;
 }
 
@@ -146,22 +312,26 @@ void inode_close(struct inode *inode)
 	if (inode == NULL)
 		return;
 	/* Release resources if this was the last opener. */
-	
-	lock_acquire(&filesys_lock);
-	if (--inode->open_cnt == 0)
+	lock_acquire(&open_inodes_lock);
+	if (--inode->open_cnt > 0)
 	{
-		/* Remove from inode list and release lock. */
-		list_remove(&inode->elem);
-		/* Deallocate blocks if removed. */
-		if (inode->removed)
-		{
-			free_map_release(inode->sector, 1);
-			free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
-		}
+		lock_release(&open_inodes_lock);
+		return;
+	}
 
-		free(inode);
+	/* Remove from inode table and release lock. */
+	hash_delete(&open_inodes, &inode->hash_elem);
+	lock_release(&open_inodes_lock);
+
+	/* Deallocate blocks if removed. */
+	if (inode->removed)
+	{
+		free_map_release(inode->sector, 1);
+		inode_release_blocks(&inode->data);
+		free_map_flush();
 	}
-	lock_release(&filesys_lock);
+
+	free(inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -169,25 +339,53 @@ void inode_close(struct inode *inode)
 void inode_remove(struct inode *inode)
 {
 	ASSERT(inode != NULL);
-	lock_acquire(&filesys_lock);
+	lock_acquire(&open_inodes_lock);
 	inode->removed = true;
-	lock_release(&filesys_lock);
+	lock_release(&open_inodes_lock);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-	Returns the number of bytes actually read, which may be less
-	than SIZE if an error occurs or end of file is reached. */
-off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset)
+/* Brings the run of contiguous sectors that holds INODE's bytes
+	from OFFSET up to END into the cache with one transfer, if the
+	run is more than one sector long.  Looks at most CACHE_RUN_MAX
+	sectors ahead.  Returns the offset just past the end of the
+	run. */
+static off_t prefetch_run(struct inode *inode, off_t offset, off_t end)
 {
-	sema_down(&inode->readers_lock);
-	if (inode->current_readers == 0)
-		sema_down(&inode->writers_lock);
-	inode->current_readers++;
-	sema_up(&inode->readers_lock);
+	block_sector_t first = byte_to_sector(inode, offset);
+	off_t pos = offset - offset % BLOCK_SECTOR_SIZE + BLOCK_SECTOR_SIZE;
+	size_t cnt = 1;
+
+	if (first == 0)
+		return pos;
+	while (cnt < CACHE_RUN_MAX && pos < end && byte_to_sector(inode, pos) == first + cnt)
+	{
+		cnt++;
+		pos += BLOCK_SECTOR_SIZE;
+	}
+	if (cnt > 1)
+		cache_prefetch(first, cnt);
+	return pos;
+}
 
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+	OFFSET, with INODE's lock already held for reading.  Returns the
+	number of bytes actually read. */
+static off_t read_at_locked(struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
 	uint8_t *buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t *bounce = NULL;
+	off_t run_end = offset;
+
+	/* An inline file's data is already in memory. */
+	if (inode->data.flags & INODE_F_INLINE)
+	{
+		if (offset < inode_length(inode) && size > 0)
+		{
+			bytes_read = inode_length(inode) - offset < size ? inode_length(inode) - offset : size;
+			memcpy(buffer, inode->data.inline_data + offset, bytes_read);
+		}
+		size = 0;
+	}
 
 	while (size > 0)
 	{
@@ -205,102 +403,232 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-		{
-			/* Read full sector directly into caller's buffer. */
-			block_read(fs_device, sector_idx, buffer + bytes_read);
-		}
+		/* Read ahead through the end of this run of contiguous
+			sectors, so that it takes one disk transfer. */
+		if (offset >= run_end)
+			run_end = prefetch_run(inode, offset, offset + size);
+
+		/* Copy the chunk out of the buffer cache, or zeros out of a
+			hole. */
+		if (sector_idx != 0)
+			cache_read_at(sector_idx, buffer + bytes_read, chunk_size, sector_ofs);
 		else
-		{
-			/* Read sector into bounce buffer, then partially copy
-				into caller's buffer. */
-			if (bounce == NULL)
-			{
-				bounce = malloc(BLOCK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-			block_read(fs_device, sector_idx, bounce);
-			memcpy(buffer + bytes_read, bounce + sector_ofs, chunk_size);
-		}
+			memset(buffer + bytes_read, 0, chunk_size);
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free(bounce);
 
-	sema_down(&inode->readers_lock);
-	inode->current_readers--;
-	if (inode->current_readers == 0)
-		sema_up(&inode->writers_lock);
-	sema_up(&inode->readers_lock);
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-	Returns the number of bytes actually written, which may be
-	less than SIZE if end of file is reached or an error occurs.
-	(Normally a write at end of file would extend the inode, but
-	growth is not yet implemented.) */
-off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size, off_t offset)
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+	Returns the number of bytes actually read, which may be less
+	than SIZE if an error occurs or end of file is reached. */
+off_t inode_read_at(struct inode *inode, void *buffer, off_t size, off_t offset)
+{
+	off_t bytes_read;
+
+	rwlock_acquire_read(&inode->rwlock);
+	bytes_read = read_at_locked(inode, buffer, size, offset);
+	rwlock_release_read(&inode->rwlock);
+	return bytes_read;
+}
+
+/* Reads INODE's bytes starting at OFFSET into the CNT buffers in
+	IOV, filling each in turn, under a single acquisition of
+	INODE's lock, so no write can land between two segments.
+	Returns the total number of bytes read, which is short if end
+	of file is reached. */
+off_t inode_readv_at(struct inode *inode, const struct iovec *iov, size_t cnt, off_t offset)
+{
+	off_t bytes_read = 0;
+
+	rwlock_acquire_read(&inode->rwlock);
+	for (; cnt > 0; iov++, cnt--)
+	{
+		off_t chunk = read_at_locked(inode, iov->iov_base, iov->iov_len, offset + bytes_read);
+
+		bytes_read += chunk;
+		if (chunk < (off_t)iov->iov_len)
+			break;
+	}
+	rwlock_release_read(&inode->rwlock);
+	return bytes_read;
+}
+
+/* Queues the sectors holding the SIZE bytes of INODE starting at
+	OFFSET for background read-ahead.  Bytes past the end of INODE
+	are ignored. */
+void inode_read_ahead(struct inode *inode, off_t offset, off_t size)
+{
+	off_t end = offset + size;
+
+	rwlock_acquire_read(&inode->rwlock);
+	if (end > inode_length(inode))
+		end = inode_length(inode);
+
+	/* An inline file has no sectors to read ahead. */
+	if (inode->data.flags & INODE_F_INLINE)
+		end = 0;
+	for (offset -= offset % BLOCK_SECTOR_SIZE; offset < end; offset += BLOCK_SECTOR_SIZE)
+	{
+		block_sector_t sector = byte_to_sector(inode, offset);
+		if (sector != 0)
+			cache_read_ahead(sector);
+	}
+	rwlock_release_read(&inode->rwlock);
+}
+
+/* Moves INODE's inline data out to a data sector of its own, so
+	that the file can grow past INODE_INLINE_SIZE.  Returns true if
+	successful, false if the disk is full, in which case INODE is
+	unchanged.  The caller must write INODE's disk inode back and
+	flush the free map. */
+static bool move_out_inline(struct inode *inode)
+{
+	uint8_t data[INODE_INLINE_SIZE];
+	block_sector_t hint = inode->sector + 1;
+
+	memcpy(data, inode->data.inline_data, sizeof data);
+	memset(inode->data.inline_data, 0, sizeof data);
+	inode->data.flags &= ~INODE_F_INLINE;
+	if (inode->data.length > 0)
+	{
+		block_sector_t sector = index_to_sector(&inode->data, 0, &hint);
+		if (sector == 0)
+		{
+			memcpy(inode->data.inline_data, data, sizeof data);
+			inode->data.flags |= INODE_F_INLINE;
+			return false;
+		}
+		cache_write_at(sector, data, inode->data.length, 0);
+	}
+	return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+	with INODE's lock already held for writing.  Returns the number
+	of bytes actually written. */
+static off_t write_at_locked(struct inode *inode, const void *buffer_, off_t size, off_t offset)
 {
 	const uint8_t *buffer = buffer_;
 	off_t bytes_written = 0;
-	uint8_t *bounce = NULL;
-	sema_down(&inode->writers_lock);
+	off_t old_length;
+	bool allocated = false;
+	bool wrote_inline = false;
+
+	old_length = inode_length(inode);
+
+	if (!length_ok(offset + size))
+		size = 0;
+
+	/* Write into an inline file's inode if the data still fits,
+		otherwise move the file's data out of the inode first. */
+	if (size > 0 && (inode->data.flags & INODE_F_INLINE))
+	{
+		if (offset + size <= (off_t) INODE_INLINE_SIZE)
+		{
+			memcpy(inode->data.inline_data + offset, buffer, size);
+			offset += size;
+			bytes_written = size;
+			size = 0;
+			wrote_inline = true;
+		}
+		else if (move_out_inline(inode))
+			allocated = true;
+		else
+			size = 0;
+	}
+
 	while (size > 0)
 	{
 		/* Sector to write, starting byte offset within sector. */
-		block_sector_t sector_idx = byte_to_sector(inode, offset);
+		size_t idx = offset / BLOCK_SECTOR_SIZE;
+		block_sector_t sector_idx = index_to_sector(&inode->data, idx, NULL);
 		int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length(inode) - offset;
+		/* Bytes left in sector, lesser of that and SIZE. */
 		int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-		int min_left = inode_left < sector_left ? inode_left : sector_left;
-
-		/* Number of bytes to actually write into this sector. */
-		int chunk_size = size < min_left ? size : min_left;
-		if (chunk_size <= 0)
-			break;
+		int chunk_size = size < sector_left ? size : sector_left;
 
-		if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+		/* Fill in a hole first, stopping if the disk is full.  The
+			new sector goes right after the file's previous one if
+			possible, or else after the inode. */
+		if (sector_idx == 0)
 		{
-			/* Write full sector directly to disk. */
-			block_write(fs_device, sector_idx, buffer + bytes_written);
-		}
-		else
-		{
-			/* We need a bounce buffer. */
-			if (bounce == NULL)
-			{
-				bounce = malloc(BLOCK_SECTOR_SIZE);
-				if (bounce == NULL)
-					break;
-			}
-
-			/* If the sector contains data before or after the chunk
-				we're writing, then we need to read in the sector
-				first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left)
-				block_read(fs_device, sector_idx, bounce);
-			else
-				memset(bounce, 0, BLOCK_SECTOR_SIZE);
-			memcpy(bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			block_write(fs_device, sector_idx, bounce);
+			block_sector_t hint = idx > 0 ? index_to_sector(&inode->data, idx - 1, NULL) : 0;
+
+			hint = (hint != 0 ? hint : inode->sector) + 1;
+			allocated = true;
+			sector_idx = index_to_sector(&inode->data, idx, &hint);
+			if (sector_idx == 0)
+				break;
 		}
 
+		/* Copy the chunk into the buffer cache.  The cache reads in
+			the rest of the sector first if the chunk doesn't cover
+			all of it. */
+		cache_write_at(sector_idx, buffer + bytes_written, chunk_size, sector_ofs);
+
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free(bounce);
 
-	sema_up(&inode->writers_lock);
+	/* Write back the disk inode if it grew, gained sectors, or
+		holds the data written. */
+	if (bytes_written > 0 && offset > inode->data.length)
+		inode->data.length = offset;
+	if (allocated || wrote_inline || inode->data.length != old_length)
+	{
+		cache_write(inode->sector, &inode->data);
+		if (allocated)
+			free_map_flush();
+	}
+
+	return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+	Returns the number of bytes actually written, which may be
+	less than SIZE if the disk fills up or an error occurs.
+	A write past end of file extends the inode, leaving a hole
+	between the old end of file and OFFSET.  Sectors are allocated
+	as they are first written.  An inline file stays inline as long
+	as it fits. */
+off_t inode_write_at(struct inode *inode, const void *buffer, off_t size, off_t offset)
+{
+	off_t bytes_written;
 
+	rwlock_acquire_write(&inode->rwlock);
+	bytes_written = write_at_locked(inode, buffer, size, offset);
+	rwlock_release_write(&inode->rwlock);
+	return bytes_written;
+}
+
+/* Writes the CNT buffers in IOV one after another into INODE,
+	starting at OFFSET, under a single acquisition of INODE's lock,
+	so no other read or write sees the file between two segments.
+	Returns the total number of bytes written, which is short if
+	the disk fills up. */
+off_t inode_writev_at(struct inode *inode, const struct iovec *iov, size_t cnt, off_t offset)
+{
+	off_t bytes_written = 0;
+
+	rwlock_acquire_write(&inode->rwlock);
+	for (; cnt > 0; iov++, cnt--)
+	{
+		off_t chunk = write_at_locked(inode, iov->iov_base, iov->iov_len, offset + bytes_written);
+
+		bytes_written += chunk;
+		if (chunk < (off_t)iov->iov_len)
+			break;
+	}
+	rwlock_release_write(&inode->rwlock);
 	return bytes_written;
 }
 
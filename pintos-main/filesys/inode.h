@@ -6,31 +6,53 @@
 #include <stdbool.h>
 
 #include <debug.h>
+#include <hash.h>
+#include <iovec.h>
 #include <list.h>
 #include <round.h>
 #include <string.h>
 #include "threads/synch.h"
 
+/* Number of data sector pointers stored in the inode itself. */
+#define INODE_DIRECT_CNT 123
+
+/* Number of sector pointers in an indirect block. */
+#define INODE_INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+/* Bytes of file data that fit in the inode itself, in place of
+	its sector pointers. */
+#define INODE_INLINE_SIZE ((INODE_DIRECT_CNT + 2) * sizeof(block_sector_t))
+
+/* Inode flags. */
+#define INODE_F_INLINE 0x1 /* Data is in inline_data, not in sectors. */
+
 /* On-disk inode.
-	Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+	Must be exactly BLOCK_SECTOR_SIZE bytes long.
+	A pointer of 0 means no sector has been allocated.
+	A file with INODE_F_INLINE set keeps its data in the space the
+	pointers would otherwise take up. */
 struct inode_disk {
-	block_sector_t start; /* First data sector. */
-	off_t length;			 /* File size in bytes. */
-	unsigned magic;		 /* Magic number. */
-	uint32_t unused[125]; /* Not used. */
+	union {
+		struct {
+			block_sector_t direct[INODE_DIRECT_CNT]; /* Data sectors. */
+			block_sector_t indirect;					  /* Block of data sector pointers. */
+			block_sector_t doubly_indirect;			  /* Block of indirect block pointers. */
+		};
+		uint8_t inline_data[INODE_INLINE_SIZE]; /* Data of an inline file. */
+	};
+	off_t length;	  /* File size in bytes. */
+	unsigned flags;  /* INODE_F_* bits. */
+	unsigned magic;  /* Magic number. */
 };
 
 /* In-memory inode. */
 struct inode {
-	struct list_elem elem;	/* Element in inode list. */
+	struct hash_elem hash_elem; /* Element in open inode table. */
 	block_sector_t sector;	/* Sector number of disk location. */
 	int open_cnt;				/* Number of openers. */
 	bool removed;				/* True if deleted, false otherwise. */
 	struct inode_disk data; /* Inode content. */
-	
-	unsigned current_readers; // :) the actual read count of how many are reading the given file currentyly concurrently actually given tfile
-	struct semaphore writers_lock; 
-	struct semaphore readers_lock;
+	struct rwlock rwlock;	/* Readers share, writers exclude all. */
 };
 
 struct bitmap;
@@ -43,7 +65,10 @@ block_sector_t inode_get_inumber(const struct inode*);
 void inode_close(struct inode*);
 void inode_remove(struct inode*);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
+void inode_read_ahead(struct inode*, off_t offset, off_t size);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+off_t inode_readv_at(struct inode*, const struct iovec*, size_t cnt, off_t offset);
+off_t inode_writev_at(struct inode*, const struct iovec*, size_t cnt, off_t offset);
 off_t inode_length(const struct inode*);
 
 #endif /* filesys/inode.h */
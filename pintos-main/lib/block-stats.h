@@ -0,0 +1,36 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+/* I/O statistics for a block device, as kept by the kernel's
+	block layer and returned to user programs by the blockstats
+	system call.  Counts start at boot. */
+
+/* Number of request size buckets.  Bucket I counts requests of
+	2**I to 2**(I + 1) - 1 sectors; the last bucket also counts
+	anything larger. */
+#define BLOCK_STATS_SIZE_CNT 10
+
+/* Number of latency buckets.  Bucket I counts requests that took
+	2**I to 2**(I + 1) - 1 microseconds, except that bucket 0 also
+	counts requests that took less than 1 microsecond and the last
+	bucket also counts anything slower. */
+#define BLOCK_STATS_LATENCY_CNT 24
+
+struct block_stats {
+	char name[16]; /* Device name, e.g. "hda". */
+	char type[8];	/* Device type, e.g. "filesys". */
+
+	unsigned long long read_bytes;		 /* Bytes read. */
+	unsigned long long write_bytes;		 /* Bytes written. */
+	unsigned long long read_requests;	 /* Read requests submitted. */
+	unsigned long long write_requests;	 /* Write requests submitted. */
+	unsigned long long latency_total;	 /* Sum of completed requests' latencies, in us. */
+	unsigned long long depth_total;		 /* Sum of queue depths seen by submitted requests. */
+	unsigned in_flight;						 /* Requests submitted but not completed. */
+	unsigned max_in_flight;					 /* Largest IN_FLIGHT so far. */
+
+	unsigned size_hist[BLOCK_STATS_SIZE_CNT];			/* Requests by size. */
+	unsigned latency_hist[BLOCK_STATS_LATENCY_CNT]; /* Completed requests by latency. */
+};
+
+#endif /* lib/block-stats.h */
@@ -0,0 +1,17 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One segment of a scatter/gather transfer, as passed to the
+	readv and writev system calls and the kernel routines behind
+	them. */
+struct iovec {
+	void* iov_base; /* Start of the segment. */
+	size_t iov_len; /* Length of the segment in bytes. */
+};
+
+/* Most segments one readv or writev call accepts. */
+#define IOV_MAX 16
+
+#endif /* lib/iovec.h */
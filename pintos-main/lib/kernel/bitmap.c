@@ -28,6 +28,7 @@ typedef unsigned long elem_type;
 	simulates an array of bits. */
 struct bitmap {
 	size_t bit_cnt;  /* Number of bits. */
+	size_t hint;	  /* Where the next next-fit scan starts. */
 	elem_type* bits; /* Elements that represent bits. */
 };
 
@@ -76,6 +77,7 @@ struct bitmap* bitmap_create(size_t bit_cnt)
 	struct bitmap* b = malloc(sizeof *b);
 	if (b != NULL) {
 		b->bit_cnt = bit_cnt;
+		b->hint = 0;
 		b->bits = malloc(byte_cnt(bit_cnt));
 		if (b->bits != NULL || bit_cnt == 0) {
 			bitmap_set_all(b, false);
@@ -97,6 +99,7 @@ struct bitmap*
 	ASSERT(block_size >= bitmap_buf_size(bit_cnt));
 
 	b->bit_cnt = bit_cnt;
+	b->hint = 0;
 	b->bits = (elem_type*) (b + 1);
 	bitmap_set_all(b, false);
 	return b;
@@ -225,20 +228,43 @@ size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value
 	return value_cnt;
 }
 
+/* Returns the index of the first bit in B at or after START that
+	is set to VALUE, or B's size if there is none.  Skips over
+	whole elements that contain no such bit. */
+static size_t find_next(const struct bitmap* b, size_t start, bool value)
+{
+	/* XORing with FLIP turns bits equal to VALUE into 1s. */
+	elem_type flip = value ? 0 : (elem_type) -1;
+	size_t last_idx = elem_cnt(b->bit_cnt);
+	size_t idx = elem_idx(start);
+	elem_type word;
+	size_t bit;
+
+	if (start >= b->bit_cnt)
+		return b->bit_cnt;
+
+	/* Ignore the bits in the first element before START. */
+	word = (b->bits[idx] ^ flip) & ~(bit_mask(start) - 1);
+	while (word == 0) {
+		if (++idx >= last_idx)
+			return b->bit_cnt;
+		word = b->bits[idx] ^ flip;
+	}
+
+	/* The padding bits in the last element may match, so clamp. */
+	bit = idx * ELEM_BITS + __builtin_ctzl(word);
+	return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Returns true if any bits in B between START and START + CNT,
 	exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value)
 {
-	size_t i;
-
 	ASSERT(b != NULL);
 	ASSERT(start <= b->bit_cnt);
 	ASSERT(start + cnt <= b->bit_cnt);
 
-	for (i = 0; i < cnt; i++)
-		if (bitmap_test(b, start + i) == value)
-			return true;
-	return false;
+	return cnt > 0 && find_next(b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -275,10 +301,24 @@ size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value)
 
 	if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
-		size_t i;
-		for (i = start; i <= last; i++)
-			if (!bitmap_contains(b, i, cnt, !value))
+		size_t i = start;
+
+		if (cnt == 0)
+			return i <= last ? i : BITMAP_ERROR;
+
+		/* Jump from the start of each run of VALUE bits to the end
+			of it, until a run is long enough. */
+		while (i <= last) {
+			size_t end;
+
+			i = find_next(b, i, value);
+			if (i > last)
+				break;
+			end = find_next(b, i, !value);
+			if (end - i >= cnt)
 				return i;
+			i = end;
+		}
 	}
 	return BITMAP_ERROR;
 }
@@ -298,6 +338,24 @@ size_t bitmap_scan_and_flip(struct bitmap* b, size_t start, size_t cnt, bool val
 	return idx;
 }
 
+/* Like bitmap_scan_and_flip(), but uses next-fit: the search
+	starts where the previous call to this function left off and
+	wraps around to the beginning of B, so that repeated
+	allocations don't rescan the crowded start of B each time. */
+size_t bitmap_scan_and_flip_next_fit(struct bitmap* b, size_t cnt, bool value)
+{
+	size_t hint = b->hint <= b->bit_cnt ? b->hint : 0;
+	size_t idx = bitmap_scan(b, hint, cnt, value);
+
+	if (idx == BITMAP_ERROR && hint > 0)
+		idx = bitmap_scan(b, 0, cnt, value);
+	if (idx != BITMAP_ERROR) {
+		bitmap_set_multiple(b, idx, cnt, !value);
+		b->hint = idx + cnt;
+	}
+	return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -327,6 +385,27 @@ bool bitmap_write(const struct bitmap* b, struct file* file)
 	off_t size = byte_cnt(b->bit_cnt);
 	return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+	to FILE, at the same position bitmap_write() would put it.
+	Whole elements are written, so bits that share an element with
+	the range are written too.  Returns true if successful, false
+	otherwise. */
+bool bitmap_write_range(const struct bitmap* b, struct file* file, size_t start, size_t cnt)
+{
+	size_t first, last;
+	off_t size;
+
+	ASSERT(start <= b->bit_cnt);
+	ASSERT(start + cnt <= b->bit_cnt);
+
+	if (cnt == 0)
+		return true;
+	first = elem_idx(start);
+	last = elem_idx(start + cnt - 1);
+	size = (last - first + 1) * sizeof(elem_type);
+	return file_write_at(file, b->bits + first, size, first * sizeof(elem_type)) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
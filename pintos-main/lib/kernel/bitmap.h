@@ -36,6 +36,7 @@ bool bitmap_all(const struct bitmap*, size_t start, size_t cnt);
 #define BITMAP_ERROR SIZE_MAX
 size_t bitmap_scan(const struct bitmap*, size_t start, size_t cnt, bool);
 size_t bitmap_scan_and_flip(struct bitmap*, size_t start, size_t cnt, bool);
+size_t bitmap_scan_and_flip_next_fit(struct bitmap*, size_t cnt, bool);
 
 /* File input and output. */
 #ifdef FILESYS
@@ -43,6 +44,7 @@ struct file;
 size_t bitmap_file_size(const struct bitmap*);
 bool bitmap_read(struct bitmap*, struct file*);
 bool bitmap_write(const struct bitmap*, struct file*);
+bool bitmap_write_range(const struct bitmap*, struct file*, size_t start, size_t cnt);
 #endif
 
 /* Debugging. */
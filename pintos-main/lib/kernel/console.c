@@ -146,6 +146,20 @@ void putbuf(const char* buffer, size_t n)
 	release_console();
 }
 
+/* Writes the CNT segments in IOV to the console, one after
+	another, without letting other output come between them. */
+void putbufv(const struct iovec* iov, size_t cnt)
+{
+	acquire_console();
+	for (; cnt > 0; iov++, cnt--) {
+		const char* buffer = iov->iov_base;
+		size_t n = iov->iov_len;
+
+		while (n-- > 0) putchar_have_lock(*buffer++);
+	}
+	release_console();
+}
+
 /* Writes C to the vga display and serial port. */
 int putchar(int c)
 {
@@ -29,6 +29,13 @@ enum {
 	SYS_READDIR, /* Reads a directory entry. */
 	SYS_ISDIR,	 /* Tests if a fd represents a directory. */
 	SYS_INUMBER, /* Returns the inode number for a fd. */
+
+	/* Extensions. */
+	SYS_BLOCKSTATS, /* Reads a block device's I/O statistics. */
+	SYS_PREAD,		 /* Read from a file at a given offset. */
+	SYS_PWRITE,		 /* Write to a file at a given offset. */
+	SYS_READV,		 /* Read from a file into several buffers. */
+	SYS_WRITEV,		 /* Write several buffers to a file. */
     SYS_NUMBER_OF_CALLS /* Needs to be last to be correct */
 };
 
@@ -1,7 +1,9 @@
 #ifndef __LIB_USER_SYSCALL_H
 #define __LIB_USER_SYSCALL_H
 
+#include <block-stats.h>
 #include <debug.h>
+#include <iovec.h>
 #include <stdbool.h>
 
 /* Process identifier. */
@@ -46,4 +48,11 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
 
+/* Extensions. */
+bool blockstats(unsigned idx, struct block_stats*);
+int pread(int fd, void* buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void* buffer, unsigned length, unsigned offset);
+int readv(int fd, const struct iovec* iov, int iovcnt);
+int writev(int fd, const struct iovec* iov, int iovcnt);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,75 @@
+/* Child process for syn-pfs test.
+	Writes a file of its own a chunk at a time and reads it back,
+	several times over, reading the shared file in between.  Other
+	processes are doing the same thing at the same time. */
+
+#include "tests/filesys/base/syn-pfs.h"
+#include "tests/lib.h"
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+
+static char shared[FILE_SIZE];
+static char data[FILE_SIZE];
+static char buf[CHUNK_SIZE];
+
+int main(int argc, char* argv[])
+{
+	char file_name[16];
+	int child_idx;
+	int pass;
+	int fd, shared_fd;
+	size_t ofs;
+
+	test_name = "child-syn-pfs";
+	quiet = true;
+
+	CHECK(argc == 2, "argc must be 2, actually %d", argc);
+	child_idx = atoi(argv[1]);
+	snprintf(file_name, sizeof file_name, "pfs-%d", child_idx);
+
+	random_init(0);
+	random_bytes(shared, sizeof shared);
+	random_init(child_idx);
+	random_bytes(data, sizeof data);
+
+	CHECK(create(file_name, 0), "create \"%s\"", file_name);
+	CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+	CHECK((shared_fd = open(shared_name)) > 1, "open \"%s\"", shared_name);
+	for (pass = 0; pass < PASS_CNT; pass++) {
+		seek(fd, 0);
+		for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+			CHECK(
+				 write(fd, data + ofs, CHUNK_SIZE) == CHUNK_SIZE,
+				 "write %zu bytes at offset %zu in \"%s\"",
+				 (size_t)CHUNK_SIZE,
+				 ofs,
+				 file_name);
+
+		seek(fd, 0);
+		seek(shared_fd, 0);
+		for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE) {
+			CHECK(
+				 read(fd, buf, CHUNK_SIZE) == CHUNK_SIZE,
+				 "read %zu bytes at offset %zu in \"%s\"",
+				 (size_t)CHUNK_SIZE,
+				 ofs,
+				 file_name);
+			compare_bytes(buf, data + ofs, CHUNK_SIZE, ofs, file_name);
+
+			CHECK(
+				 read(shared_fd, buf, CHUNK_SIZE) == CHUNK_SIZE,
+				 "read %zu bytes at offset %zu in \"%s\"",
+				 (size_t)CHUNK_SIZE,
+				 ofs,
+				 shared_name);
+			compare_bytes(buf, shared + ofs, CHUNK_SIZE, ofs, shared_name);
+		}
+	}
+	close(shared_fd);
+	close(fd);
+
+	return child_idx;
+}
@@ -0,0 +1,47 @@
+/* Spawns several child processes that each write and read back a
+	file of their own, all at the same time, while also reading a
+	shared file.  Then verifies every child's file.  Independent
+	files should be usable concurrently, and readers of the shared
+	file should not block each other. */
+
+#include "tests/filesys/base/syn-pfs.h"
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+
+static char buf1[FILE_SIZE];
+static char buf2[FILE_SIZE];
+
+void test_main(void)
+{
+	pid_t children[CHILD_CNT];
+	int fd;
+	int i;
+
+	CHECK(create(shared_name, 0), "create \"%s\"", shared_name);
+	CHECK((fd = open(shared_name)) > 1, "open \"%s\"", shared_name);
+	random_bytes(buf1, sizeof buf1);
+	CHECK(write(fd, buf1, sizeof buf1) == sizeof buf1, "write \"%s\"", shared_name);
+	msg("close \"%s\"", shared_name);
+	close(fd);
+
+	exec_children("child-syn-pfs", children, CHILD_CNT);
+	wait_children(children, CHILD_CNT);
+
+	for (i = 0; i < CHILD_CNT; i++) {
+		char file_name[16];
+
+		snprintf(file_name, sizeof file_name, "pfs-%d", i);
+		random_init(i);
+		random_bytes(buf1, sizeof buf1);
+		CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+		CHECK(read(fd, buf2, sizeof buf2) == sizeof buf2, "read \"%s\"", file_name);
+		compare_bytes(buf2, buf1, sizeof buf1, 0, file_name);
+		msg("close \"%s\"", file_name);
+		close(fd);
+	}
+}
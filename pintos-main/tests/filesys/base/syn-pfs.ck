@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(syn-pfs) begin
+(syn-pfs) create "shared"
+(syn-pfs) open "shared"
+(syn-pfs) write "shared"
+(syn-pfs) close "shared"
+(syn-pfs) exec child 1 of 4: "child-syn-pfs 0"
+(syn-pfs) exec child 2 of 4: "child-syn-pfs 1"
+(syn-pfs) exec child 3 of 4: "child-syn-pfs 2"
+(syn-pfs) exec child 4 of 4: "child-syn-pfs 3"
+(syn-pfs) wait for child 1 of 4 returned 0 (expected 0)
+(syn-pfs) wait for child 2 of 4 returned 1 (expected 1)
+(syn-pfs) wait for child 3 of 4 returned 2 (expected 2)
+(syn-pfs) wait for child 4 of 4 returned 3 (expected 3)
+(syn-pfs) open "pfs-0"
+(syn-pfs) read "pfs-0"
+(syn-pfs) close "pfs-0"
+(syn-pfs) open "pfs-1"
+(syn-pfs) read "pfs-1"
+(syn-pfs) close "pfs-1"
+(syn-pfs) open "pfs-2"
+(syn-pfs) read "pfs-2"
+(syn-pfs) close "pfs-2"
+(syn-pfs) open "pfs-3"
+(syn-pfs) read "pfs-3"
+(syn-pfs) close "pfs-3"
+(syn-pfs) end
+EOF
+pass;
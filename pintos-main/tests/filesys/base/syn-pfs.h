@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BASE_SYN_PFS_H
+#define TESTS_FILESYS_BASE_SYN_PFS_H
+
+#define CHILD_CNT	 4
+#define PASS_CNT	 3
+#define CHUNK_SIZE 1024
+#define FILE_SIZE	 (16 * CHUNK_SIZE)
+static const char shared_name[] = "shared";
+
+#endif /* tests/filesys/base/syn-pfs.h */
@@ -0,0 +1,46 @@
+/* Creates a file three times the size of the file system disk,
+	which only works if its unwritten sectors take no space.
+	Checks that they read back as zeros, writes a few of them,
+	reads the data back, and removes the file. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#include <random.h>
+#include <syscall.h>
+
+#define FILE_SIZE (6 * 1024 * 1024)
+
+static char buf[512];
+static char data[512];
+static char zeros[512];
+
+void test_main(void)
+{
+	const char* file_name = "sparse";
+	int fd;
+
+	CHECK(create(file_name, FILE_SIZE), "create \"%s\"", file_name);
+	CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+	CHECK(filesize(fd) == FILE_SIZE, "filesize \"%s\"", file_name);
+
+	seek(fd, FILE_SIZE / 2 + 100);
+	CHECK(read(fd, buf, sizeof buf) == sizeof buf, "read middle of \"%s\"", file_name);
+	compare_bytes(buf, zeros, sizeof buf, FILE_SIZE / 2 + 100, file_name);
+
+	random_init(0);
+	random_bytes(data, sizeof data);
+	seek(fd, FILE_SIZE - 1000);
+	CHECK(write(fd, data, sizeof data) == sizeof data, "write near end of \"%s\"", file_name);
+	msg("close \"%s\"", file_name);
+	close(fd);
+
+	CHECK((fd = open(file_name)) > 1, "open \"%s\" for verification", file_name);
+	seek(fd, FILE_SIZE - 1000);
+	CHECK(read(fd, buf, sizeof buf) == sizeof buf, "read near end of \"%s\"", file_name);
+	compare_bytes(buf, data, sizeof buf, FILE_SIZE - 1000, file_name);
+	msg("close \"%s\"", file_name);
+	close(fd);
+
+	CHECK(remove(file_name), "remove \"%s\"", file_name);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) create "sparse"
+(grow-sparse-lg) open "sparse"
+(grow-sparse-lg) filesize "sparse"
+(grow-sparse-lg) read middle of "sparse"
+(grow-sparse-lg) write near end of "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) open "sparse" for verification
+(grow-sparse-lg) read near end of "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) remove "sparse"
+(grow-sparse-lg) end
+EOF
+pass;
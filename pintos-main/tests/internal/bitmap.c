@@ -0,0 +1,135 @@
+/* Test and benchmark program for bitmap_scan() in
+	lib/kernel/bitmap.c.
+
+	Checks bitmap_scan() against a straightforward bit-at-a-time
+	reference scan on random bitmaps, then times both on large,
+	nearly full bitmaps like the ones palloc and the free map scan
+	when memory or disk runs low.
+
+	This is not a test we will run on your submitted projects.
+	It is here for completeness.
+*/
+
+#undef NDEBUG
+#include "threads/test.h"
+
+#include "devices/timer.h"
+
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+
+/* Size of the bitmaps used for benchmarking, in bits. */
+#define BENCH_BITS (64 * 1024)
+
+/* Number of scans timed per run. */
+#define BENCH_SCANS 64
+
+static size_t reference_scan(const struct bitmap*, size_t start, size_t cnt, bool);
+static void verify_scan(void);
+static void bench_scan(size_t free_cnt, size_t cnt);
+
+/* Test and benchmark bitmap_scan(). */
+void test(void)
+{
+	verify_scan();
+
+	printf("bitmap: %d-bit bitmaps, %d scans per run\n", BENCH_BITS, BENCH_SCANS);
+	bench_scan(0, 1);
+	bench_scan(16, 1);
+	bench_scan(16, 8);
+	bench_scan(256, 4);
+	printf("bitmap: PASS\n");
+}
+
+/* Finds the first run of CNT bits set to VALUE at or after START
+	the way bitmap_scan() used to, testing every candidate start
+	bit by bit. */
+static size_t reference_scan(const struct bitmap* b, size_t start, size_t cnt, bool value)
+{
+	if (cnt <= bitmap_size(b)) {
+		size_t last = bitmap_size(b) - cnt;
+		size_t i, j;
+
+		for (i = start; i <= last; i++) {
+			for (j = 0; j < cnt; j++)
+				if (bitmap_test(b, i + j) != value)
+					break;
+			if (j == cnt)
+				return i;
+		}
+	}
+	return BITMAP_ERROR;
+}
+
+/* Compares bitmap_scan() with reference_scan() on random bitmaps
+	of various sizes and densities. */
+static void verify_scan(void)
+{
+	size_t size;
+
+	printf("verifying bitmap_scan:");
+	for (size = 0; size < 200; size += 7) {
+		struct bitmap* b = bitmap_create(size);
+		int repeat;
+
+		ASSERT(b != NULL);
+		printf(" %zu", size);
+		for (repeat = 0; repeat < 50; repeat++) {
+			unsigned density = random_ulong() % 100;
+			size_t i;
+
+			for (i = 0; i < size; i++)
+				bitmap_set(b, i, random_ulong() % 100 < density);
+			for (i = 0; i < 20; i++) {
+				size_t start = random_ulong() % (size + 1);
+				size_t cnt = random_ulong() % 12;
+				bool value = random_ulong() % 2;
+
+				ASSERT(bitmap_scan(b, start, cnt, value) == reference_scan(b, start, cnt, value));
+			}
+		}
+		bitmap_destroy(b);
+	}
+	printf(" done\n");
+}
+
+/* Times BENCH_SCANS searches for CNT free bits in a BENCH_BITS
+	bitmap that is full except for FREE_CNT free bits, scattered
+	singly through the second half of the bitmap, and a final
+	free run of CNT bits at the very end. */
+static void bench_scan(size_t free_cnt, size_t cnt)
+{
+	struct bitmap* b = bitmap_create(BENCH_BITS);
+	size_t expected, i;
+	int64_t start;
+	int64_t old_ticks, new_ticks;
+
+	ASSERT(b != NULL);
+	bitmap_set_all(b, true);
+	for (i = 0; i < free_cnt; i++)
+		bitmap_reset(b, BENCH_BITS / 2 + random_ulong() % (BENCH_BITS / 2 - 2 * cnt));
+	bitmap_set_multiple(b, BENCH_BITS - cnt, cnt, false);
+	expected = reference_scan(b, 0, cnt, false);
+	ASSERT(expected != BITMAP_ERROR);
+
+	start = timer_ticks();
+	for (i = 0; i < BENCH_SCANS; i++)
+		ASSERT(reference_scan(b, 0, cnt, false) == expected);
+	old_ticks = timer_elapsed(start);
+
+	start = timer_ticks();
+	for (i = 0; i < BENCH_SCANS; i++)
+		ASSERT(bitmap_scan(b, 0, cnt, false) == expected);
+	new_ticks = timer_elapsed(start);
+
+	printf(
+		 "bitmap: %zu scattered free bits, run of %zu: "
+		 "bit-at-a-time %lld ticks, word-at-a-time %lld ticks\n",
+		 free_cnt,
+		 cnt,
+		 old_ticks,
+		 new_ticks);
+	bitmap_destroy(b);
+}
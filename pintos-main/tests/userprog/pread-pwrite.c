@@ -0,0 +1,40 @@
+/* Writes and reads back a file with pwrite and pread at an
+	offset past the start, and checks that neither moves the file
+	position. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+#include <string.h>
+#include <syscall.h>
+
+#define OFS 100
+
+void test_main(void)
+{
+	char buf[sizeof sample];
+	size_t len = sizeof sample - 1;
+	size_t i;
+	int fd;
+
+	CHECK(create("data", 0), "create \"data\"");
+	CHECK((fd = open("data")) > 1, "open \"data\"");
+
+	CHECK(pwrite(fd, sample, len, OFS) == (int)len, "pwrite at %d", OFS);
+	CHECK(tell(fd) == 0, "file position unchanged");
+	CHECK(filesize(fd) == (int)(OFS + len), "file size is %d", (int)(OFS + len));
+
+	CHECK(pread(fd, buf, len, OFS) == (int)len, "pread at %d", OFS);
+	if (memcmp(buf, sample, len))
+		fail("pread returned wrong data");
+	CHECK(pread(fd, buf, OFS, 0) == OFS, "pread at 0");
+	for (i = 0; i < OFS; i++)
+		if (buf[i] != 0)
+			fail("byte %zu before the pwrite is %d, not 0", i, buf[i]);
+	CHECK(pread(fd, buf, len, OFS + len) == 0, "pread at end of file");
+	CHECK(tell(fd) == 0, "file position unchanged");
+
+	msg("close \"data\"");
+	close(fd);
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) pwrite at 100
+(pread-pwrite) file position unchanged
+(pread-pwrite) file size is 339
+(pread-pwrite) pread at 100
+(pread-pwrite) pread at 0
+(pread-pwrite) pread at end of file
+(pread-pwrite) file position unchanged
+(pread-pwrite) close "data"
+(pread-pwrite) end
+pread-pwrite: exit(0)
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Writes a header and a payload with one writev call, reads them
+	back with one readv call split at a different point, and checks
+	the data and the file position. */
+
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/sample.inc"
+
+#include <string.h>
+#include <syscall.h>
+
+#define HDR_SIZE 16
+#define SPLIT 100
+
+void test_main(void)
+{
+	char hdr[HDR_SIZE];
+	char buf[HDR_SIZE + sizeof sample];
+	size_t len = sizeof sample - 1;
+	struct iovec iov[3];
+	int fd;
+
+	memset(hdr, 'h', sizeof hdr);
+	CHECK(create("data", 0), "create \"data\"");
+	CHECK((fd = open("data")) > 1, "open \"data\"");
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof hdr;
+	iov[1].iov_base = sample;
+	iov[1].iov_len = len;
+	CHECK(writev(fd, iov, 2) == (int)(HDR_SIZE + len), "writev header and payload");
+	CHECK(tell(fd) == HDR_SIZE + len, "file position advanced");
+
+	seek(fd, 0);
+	memset(buf, 0, sizeof buf);
+	iov[0].iov_base = buf;
+	iov[0].iov_len = SPLIT;
+	iov[1].iov_base = buf + SPLIT;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = buf + SPLIT;
+	iov[2].iov_len = sizeof buf - SPLIT;
+	CHECK(readv(fd, iov, 3) == (int)(HDR_SIZE + len), "readv whole file");
+	if (memcmp(buf, hdr, HDR_SIZE) || memcmp(buf + HDR_SIZE, sample, len))
+		fail("readv returned wrong data");
+
+	CHECK(writev(fd, iov, -1) == -1, "writev with negative count");
+
+	msg("close \"data\"");
+	close(fd);
+}
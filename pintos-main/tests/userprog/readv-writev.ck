@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev header and payload
+(readv-writev) file position advanced
+(readv-writev) readv whole file
+(readv-writev) writev with negative count
+(readv-writev) close "data"
+(readv-writev) end
+readv-writev: exit(0)
+EOF
+pass;
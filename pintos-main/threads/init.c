@@ -37,6 +37,9 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/raid0.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -52,6 +55,13 @@ static bool format_filesys;
 	overriding the defaults. */
 static const char* filesys_bdev_name;
 static const char* scratch_bdev_name;
+
+/* -raid0: Comma-separated names of block devices to stripe into
+	md0, or null for none. */
+static char* raid0_members;
+
+/* -ramdisk: Size of RAM disk rd0 in kB, or 0 for none. */
+static size_t ramdisk_kb;
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
@@ -138,6 +148,10 @@ int main(void)
 #ifdef FILESYS
 	/* Initialize file system. */
 	ide_init();
+	virtio_blk_init();
+	if (raid0_members != NULL)
+		raid0_init(raid0_members);
+	ramdisk_init(ramdisk_kb);
 	locate_block_devices();
 	filesys_init(format_filesys);
 #endif
@@ -259,6 +273,10 @@ static char** parse_options(char** argv)
 			filesys_bdev_name = value;
 		else if (!strcmp(name, "-scratch"))
 			scratch_bdev_name = value;
+		else if (!strcmp(name, "-raid0"))
+			raid0_members = value;
+		else if (!strcmp(name, "-ramdisk"))
+			ramdisk_kb = atoi(value);
 #ifdef VM
 		else if (!strcmp(name, "-swap"))
 			swap_bdev_name = value;
@@ -388,6 +406,8 @@ static void usage(void)
 		 "  -f                 Format file system device during startup.\n"
 		 "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
 		 "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+		 "  -raid0=BDEV,...    Stripe BDEVs into block device md0.\n"
+		 "  -ramdisk=KB        Create KB-kilobyte RAM block device rd0.\n"
 #ifdef VM
 		 "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -316,3 +316,106 @@ void cond_broadcast(struct condition* cond, struct lock* lock)
 
 	while (!list_empty(&cond->waiters)) cond_signal(cond, lock);
 }
+
+/* Initializes RWLOCK.  A readers-writer lock can be held by any
+	number of readers at once, or by a single writer.
+
+	To keep either side from starving the other, a reader that
+	arrives while a writer is waiting waits too, and a writer that
+	releases the lock lets in every reader that was waiting before
+	it lets in the next writer.  Readers and writers thus take
+	turns whenever both are waiting.
+
+	A readers-writer lock is not recursive: a thread holding it
+	must not acquire it again, in either mode. */
+void rwlock_init(struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	lock_init(&rwlock->lock);
+	cond_init(&rwlock->can_read);
+	cond_init(&rwlock->can_write);
+	rwlock->readers = 0;
+	rwlock->writer = NULL;
+	rwlock->waiting_readers = 0;
+	rwlock->waiting_writers = 0;
+	rwlock->read_batch = 0;
+}
+
+/* Acquires RWLOCK for reading, sleeping until no writer holds it
+	or is waiting for it, unless this reader is part of the batch
+	let in by the last writer. */
+void rwlock_acquire_read(struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+	ASSERT(!intr_context());
+	ASSERT(!rwlock_held_for_write(rwlock));
+
+	lock_acquire(&rwlock->lock);
+	rwlock->waiting_readers++;
+	while (rwlock->writer != NULL || (rwlock->waiting_writers > 0 && rwlock->read_batch == 0))
+		cond_wait(&rwlock->can_read, &rwlock->lock);
+	rwlock->waiting_readers--;
+	if (rwlock->read_batch > 0)
+		rwlock->read_batch--;
+	rwlock->readers++;
+	lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+	reading. */
+void rwlock_release_read(struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	lock_acquire(&rwlock->lock);
+	ASSERT(rwlock->readers > 0);
+	if (--rwlock->readers == 0 && rwlock->read_batch == 0)
+		cond_signal(&rwlock->can_write, &rwlock->lock);
+	lock_release(&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no other thread
+	holds it and no batch of readers is still due to enter. */
+void rwlock_acquire_write(struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+	ASSERT(!intr_context());
+	ASSERT(!rwlock_held_for_write(rwlock));
+
+	lock_acquire(&rwlock->lock);
+	rwlock->waiting_writers++;
+	while (rwlock->writer != NULL || rwlock->readers > 0 || rwlock->read_batch > 0)
+		cond_wait(&rwlock->can_write, &rwlock->lock);
+	rwlock->waiting_writers--;
+	rwlock->writer = thread_current();
+	lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold for
+	writing.  Readers that were waiting go first, then the next
+	writer. */
+void rwlock_release_write(struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+	ASSERT(rwlock_held_for_write(rwlock));
+
+	lock_acquire(&rwlock->lock);
+	rwlock->writer = NULL;
+	if (rwlock->waiting_readers > 0) {
+		rwlock->read_batch = rwlock->waiting_readers;
+		cond_broadcast(&rwlock->can_read, &rwlock->lock);
+	}
+	else
+		cond_signal(&rwlock->can_write, &rwlock->lock);
+	lock_release(&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+	false otherwise. */
+bool rwlock_held_for_write(const struct rwlock* rwlock)
+{
+	ASSERT(rwlock != NULL);
+
+	return rwlock->writer == thread_current();
+}
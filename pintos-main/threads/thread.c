@@ -72,6 +72,7 @@ static void *alloc_frame(struct thread *, size_t size);
 static void schedule(void);
 void thread_schedule_tail(struct thread *prev);
 static tid_t allocate_tid(void);
+static tid_t spawn_thread(const char *name, int priority, thread_func *, void *aux);
 
 /* Initializes the threading system by transforming the code
 	that's currently running into a thread.  This can't work in
@@ -164,6 +165,23 @@ void thread_print_stats(void)
 	PRIORITY, but no actual priority scheduling is implemented.
 	Priority scheduling is the goal of Problem 1-3. */
 tid_t thread_create(const char *name, int priority, thread_func *function, void *aux)
+{
+	if (DEBUG_thread_create_simulate_fail())
+		return TID_ERROR;
+
+	return spawn_thread(name, priority, function, aux);
+}
+
+/* Like thread_create(), but for kernel service threads that live
+	as long as the kernel does, such as the buffer cache's helper
+	threads.  These do not count against the -tcl limit. */
+tid_t thread_create_daemon(const char *name, int priority, thread_func *function, void *aux)
+{
+	return spawn_thread(name, priority, function, aux);
+}
+
+/* Does the work of thread_create(). */
+static tid_t spawn_thread(const char *name, int priority, thread_func *function, void *aux)
 {
 	struct thread *t;
 	struct kernel_thread_frame *kf;
@@ -173,9 +191,6 @@ tid_t thread_create(const char *name, int priority, thread_func *function, void
 
 	ASSERT(function != NULL);
 
-	if (DEBUG_thread_create_simulate_fail())
-		return TID_ERROR;
-
 	/* Allocate thread. */
 	t = palloc_get_page(PAL_ZERO);
 	if (t == NULL)
@@ -460,12 +475,13 @@ static void init_thread(struct thread *t, const char *name, int priority)
 	t->priority = priority;
 	t->magic = THREAD_MAGIC;
 	/*
-	We innit a list of file_descriptors for each thread, and we set the next_fd to 2, since 0 and 1 are reserved for stdin and stdout.
+	The descriptor table is allocated on the first open.  Descriptors 0 and 1 are reserved for stdin and stdout.
 	*/
 
 #ifdef USERPROG
-	list_init(&t->file_descriptors);
-	t->next_fd = 2;
+	t->fds = NULL;
+	t->fd_cnt = 0;
+	t->fd_first_free = 2;
 	list_init(&t->child_relations);
 	t->waiting = false;
 
@@ -9,7 +9,11 @@
 #include "threads/synch.h"
 
 #ifdef USERPROG
-#define MAX_FDS 130
+/* Most file descriptors a process may have, counting stdin and
+	stdout.  The descriptor table starts at FD_TABLE_INIT entries
+	and doubles as needed up to this limit. */
+#define MAX_FDS 1024
+#define FD_TABLE_INIT 16
 #endif
 
 /* States in a thread's life cycle. */
@@ -107,12 +111,6 @@ struct shared_mem
 	struct list_elem elem;
 };
 
-struct file_descriptor
-{
-	int fd;
-	struct file *file;
-	struct list_elem elem;
-};
 struct thread
 {
 	/* Owned by thread.c. */
@@ -129,8 +127,9 @@ struct thread
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint32_t *pagedir; /* Page directory. */
-	int next_fd;
-	struct list file_descriptors;
+	struct file **fds;	/* Open files indexed by fd, null if free. */
+	int fd_cnt;			/* Number of entries in fds. */
+	int fd_first_free;	/* Every fd from 2 up to this one is in use. */
 
 	bool waiting;
 
@@ -157,6 +156,7 @@ void thread_print_stats(void);
 
 typedef void thread_func(void *aux);
 tid_t thread_create(const char *name, int priority, thread_func *, void *);
+tid_t thread_create_daemon(const char *name, int priority, thread_func *, void *);
 
 void thread_block(void);
 void thread_unblock(struct thread *);
@@ -259,14 +259,14 @@ void process_exit(void)
 	} // IM DYING HERER
 
 	/* Close all open files. */
+	for (int fd = 2; fd < cur->fd_cnt; fd++)
+		if (cur->fds[fd] != NULL)
+			file_close(cur->fds[fd]);
+	free(cur->fds);
+	cur->fds = NULL;
+	cur->fd_cnt = 0;
+
 	struct list_elem *e;
-	struct file_descriptor *fd_entry;
-	for (e = list_begin(&cur->file_descriptors); e != list_end(&cur->file_descriptors); e = list_next(e))
-	{
-		fd_entry = list_entry(e, struct file_descriptor, elem);
-		file_close(fd_entry->file);
-		// list_remove(e);
-	}
 	// Children, I AM DYING!!
 	struct shared_mem *sm;
 	for (e = list_begin(&cur->child_relations); e != list_end(&cur->child_relations); e = list_next(e))
@@ -1,7 +1,9 @@
 
 #include "userprog/syscall.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/timer.h"
 #include "devices/shutdown.h"
@@ -9,126 +11,244 @@
 #include "threads/vaddr.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/malloc.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 
 static void syscall_handler(struct intr_frame *);
 
-void retrieve_args(void *esp, int *argv[]);
-void retrive_args1(void *esp, int *argv[], unsigned argc);
+/* Runs a system call on its fetched and checked arguments. */
+typedef uint32_t syscall_func(const uint32_t *argv);
+
 // get file
 struct file *get_file(int fd);
 
 void halt(void);
 void exit(int status);
 pid_t exec(const char *cmd_line);
+int wait(pid_t pid);
 bool create(const char *file, unsigned initial_size);
 int open(const char *file_name);
 void close(int fd);
 int write(int fd, const void *buffer, unsigned size);
 int read(int fd, void *buffer, unsigned size);
+int pread(int fd, void *buffer, unsigned size, unsigned offset);
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
 bool remove(const char *file);
 int filesize(int fd);
 void sleep(int millis);
+bool blockstats(unsigned idx, struct block_stats *stats);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
-void validate_pointer(void *ptr);
-void validate_buffer(void *buffer, unsigned size);
+bool user_range_ok(const void *uaddr, size_t size);
+void copy_from_user(void *dst, const void *usrc, size_t size);
+void copy_to_user(void *udst, const void *src, size_t size);
+int strncpy_from_user(char *dst, const char *usrc, size_t size);
+void validate_buffer(const void *buffer, unsigned size);
 void validate_string(const char *str);
-void validate_set_args(void *esp, int amount);
 
-#define MAX_ARGS 3
-#define MAX_FDS 130
+#define MAX_ARGS 4
 
-void syscall_init(void)
+static uint32_t sys_halt(const uint32_t *argv UNUSED)
 {
-	intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+	halt();
+	NOT_REACHED();
 }
 
-void validate_set_args(void *esp, int amount)
+static uint32_t sys_exit(const uint32_t *argv)
 {
-	// check all bytes of the arguments
-	int bytes_to_check = amount * sizeof(int);
-	for (int i = 0; i < bytes_to_check; i++)
-	{
-		validate_pointer(esp + i);
-	}
+	exit(argv[0]);
+	NOT_REACHED();
+}
+
+static uint32_t sys_exec(const uint32_t *argv)
+{
+	return exec((const char *)argv[0]);
+}
+
+static uint32_t sys_wait(const uint32_t *argv)
+{
+	return wait(argv[0]);
+}
+
+static uint32_t sys_create(const uint32_t *argv)
+{
+	return create((const char *)argv[0], argv[1]);
+}
+
+static uint32_t sys_remove(const uint32_t *argv)
+{
+	return remove((const char *)argv[0]);
+}
+
+static uint32_t sys_open(const uint32_t *argv)
+{
+	return open((const char *)argv[0]);
+}
+
+static uint32_t sys_filesize(const uint32_t *argv)
+{
+	return filesize(argv[0]);
+}
+
+static uint32_t sys_read(const uint32_t *argv)
+{
+	return read(argv[0], (void *)argv[1], argv[2]);
+}
+
+static uint32_t sys_write(const uint32_t *argv)
+{
+	return write(argv[0], (const void *)argv[1], argv[2]);
+}
+
+static uint32_t sys_pread(const uint32_t *argv)
+{
+	return pread(argv[0], (void *)argv[1], argv[2], argv[3]);
+}
+
+static uint32_t sys_pwrite(const uint32_t *argv)
+{
+	return pwrite(argv[0], (const void *)argv[1], argv[2], argv[3]);
+}
+
+static uint32_t sys_readv(const uint32_t *argv)
+{
+	return readv(argv[0], (const struct iovec *)argv[1], argv[2]);
+}
+
+static uint32_t sys_writev(const uint32_t *argv)
+{
+	return writev(argv[0], (const struct iovec *)argv[1], argv[2]);
+}
+
+static uint32_t sys_seek(const uint32_t *argv)
+{
+	seek(argv[0], argv[1]);
+	return 0;
+}
+
+static uint32_t sys_tell(const uint32_t *argv)
+{
+	return tell(argv[0]);
+}
+
+static uint32_t sys_close(const uint32_t *argv)
+{
+	close(argv[0]);
+	return 0;
+}
+
+static uint32_t sys_sleep(const uint32_t *argv)
+{
+	sleep(argv[0]);
+	return 0;
+}
+
+static uint32_t sys_blockstats(const uint32_t *argv)
+{
+	return blockstats(argv[0], (struct block_stats *)argv[1]);
 }
 
+/**
+ * Kinds of system call arguments.  syscall_handler() checks
+ * pointer arguments before the handler runs, so handlers only
+ * see user memory that is mapped.  A call given a file descriptor
+ * that is not open fails with -1 without running its handler.
+ */
+enum arg_kind
+{
+	ARG_INT,	/* Plain integer. */
+	ARG_FD,		/* Stdin, stdout or an open file's descriptor. */
+	ARG_STRING, /* Null-terminated user string. */
+	ARG_BUFFER, /* User buffer whose size is the next argument. */
+	ARG_SIZE,	/* Size of the preceding ARG_BUFFER. */
+	ARG_PTR,	/* User pointer the handler copies through itself. */
+};
+
+/**
+ * A system call: its handler and the kinds of its arguments.
+ */
+struct syscall
+{
+	syscall_func *func;		   /* Handler, returns the value for eax. */
+	int argc;				   /* Number of arguments. */
+	enum arg_kind kinds[MAX_ARGS]; /* Kind of each argument. */
+};
+
+/**
+ * System calls, indexed by number.  Numbers without a handler
+ * kill the caller.
+ */
+static const struct syscall syscalls[SYS_NUMBER_OF_CALLS] = {
+	[SYS_HALT] = {sys_halt, 0, {}},
+	[SYS_EXIT] = {sys_exit, 1, {ARG_INT}},
+	[SYS_EXEC] = {sys_exec, 1, {ARG_STRING}},
+	[SYS_WAIT] = {sys_wait, 1, {ARG_INT}},
+	[SYS_CREATE] = {sys_create, 2, {ARG_STRING, ARG_INT}},
+	[SYS_REMOVE] = {sys_remove, 1, {ARG_STRING}},
+	[SYS_OPEN] = {sys_open, 1, {ARG_STRING}},
+	[SYS_FILESIZE] = {sys_filesize, 1, {ARG_FD}},
+	[SYS_READ] = {sys_read, 3, {ARG_FD, ARG_BUFFER, ARG_SIZE}},
+	[SYS_WRITE] = {sys_write, 3, {ARG_FD, ARG_BUFFER, ARG_SIZE}},
+	[SYS_SEEK] = {sys_seek, 2, {ARG_FD, ARG_INT}},
+	[SYS_TELL] = {sys_tell, 1, {ARG_FD}},
+	[SYS_CLOSE] = {sys_close, 1, {ARG_FD}},
+	[SYS_SLEEP] = {sys_sleep, 1, {ARG_INT}},
+	[SYS_BLOCKSTATS] = {sys_blockstats, 2, {ARG_INT, ARG_PTR}},
+	[SYS_PREAD] = {sys_pread, 4, {ARG_FD, ARG_BUFFER, ARG_SIZE, ARG_INT}},
+	[SYS_PWRITE] = {sys_pwrite, 4, {ARG_FD, ARG_BUFFER, ARG_SIZE, ARG_INT}},
+	[SYS_READV] = {sys_readv, 3, {ARG_FD, ARG_PTR, ARG_INT}},
+	[SYS_WRITEV] = {sys_writev, 3, {ARG_FD, ARG_PTR, ARG_INT}},
+};
+
+void syscall_init(void)
+{
+	intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+}
+
+/**
+ * Looks up the system call numbered at the top of the user stack,
+ * fetches all of its arguments in one copy, checks its file
+ * descriptor, string and buffer arguments, and runs its handler.
+ */
 static void syscall_handler(struct intr_frame *f)
 {
-	// retrieve system call number
-	int argv[MAX_ARGS];
+	uint32_t argv[MAX_ARGS];
+	int syscall_num;
+	const struct syscall *sc;
 
-	// check if the stack is valid
-	for (int i = 0; i < 4; i++)
-	{
-		validate_pointer(f->esp + i);
-	}
+	copy_from_user(&syscall_num, f->esp, sizeof syscall_num);
+	if (syscall_num < 0 || syscall_num >= SYS_NUMBER_OF_CALLS)
+		exit(-1);
+	sc = &syscalls[syscall_num];
+	if (sc->func == NULL)
+		exit(-1);
 
-	int syscall_num = *(int *)f->esp;
-	switch (syscall_num)
+	copy_from_user(argv, (uint32_t *)f->esp + 1, sc->argc * sizeof *argv);
+	for (int i = 0; i < sc->argc; i++)
 	{
-	case SYS_HALT:
-		halt();
-		break;
-	case SYS_EXIT:
-		retrive_args1(f->esp, argv, 1);
-		exit(argv[0]);
-		break;
-	case SYS_EXEC:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = exec(argv[0]);
-		break;
-	case SYS_WAIT:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = wait(argv[0]);
-		break;
-	case SYS_CREATE:
-		retrive_args1(f->esp, argv, 2);
-		f->eax = create(argv[0], argv[1]);
-		break;
-	case SYS_REMOVE:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = remove(argv[0]);
-		break;
-	case SYS_OPEN:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = open(argv[0]);
-		break;
-	case SYS_FILESIZE:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = filesize(argv[0]);
-		break;
-	case SYS_READ:
-		retrive_args1(f->esp, argv, 3);
-		f->eax = read(argv[0], argv[1], argv[2]);
-		break;
-	case SYS_WRITE:
-		retrive_args1(f->esp, argv, 3);
-		f->eax = write(argv[0], argv[1], argv[2]);
-		break;
-	case SYS_SEEK:
-		retrive_args1(f->esp, argv, 2);
-		seek(argv[0], argv[1]);
-		break;
-	case SYS_TELL:
-		retrive_args1(f->esp, argv, 1);
-		f->eax = tell(argv[0]);
-		break;
-	case SYS_CLOSE:
-		retrive_args1(f->esp, argv, 1);
-		close(argv[0]);
-		break;
-	case SYS_SLEEP:
-		retrive_args1(f->esp, argv, 1);
-		sleep(argv[0]);
-		break;
-	default:
-		exit(-1);
-		break;
+		if (sc->kinds[i] == ARG_FD)
+		{
+			int fd = argv[i];
+			if (fd != 0 && fd != 1 && get_file(fd) == NULL)
+			{
+				f->eax = -1;
+				return;
+			}
+		}
+		else if (sc->kinds[i] == ARG_STRING)
+			validate_string((const char *)argv[i]);
+		else if (sc->kinds[i] == ARG_BUFFER)
+			validate_buffer((const void *)argv[i], argv[i + 1]);
 	}
-	// sleep(1);
+
+	f->eax = sc->func(argv);
 }
 
 void halt(void)
@@ -146,7 +266,6 @@ void exit(int status)
 
 pid_t exec(const char *cmd_line)
 {
-	validate_string(cmd_line);
 	return process_execute(cmd_line);
 }
 
@@ -157,80 +276,91 @@ int wait(pid_t pid)
 
 bool create(const char *file, unsigned initial_size)
 {
-	validate_string(file);
-	return filesys_create(file, initial_size);
+	char name[NAME_MAX + 1];
+
+	if (strncpy_from_user(name, file, sizeof name) < 0)
+		return false;
+	return filesys_create(name, initial_size);
 }
 
 /**
- * Returns the file associated with the given file descriptor.
+ * Returns the file associated with the given file descriptor, or
+ * NULL if FD is not open.
  */
 struct file *get_file(int fd)
 {
 	struct thread *cur = thread_current();
-	if (fd < 2 || fd >= MAX_FDS)
+	if (fd < 2 || fd >= cur->fd_cnt)
 		return NULL;
+	return cur->fds[fd];
+}
+
+/**
+ * Returns the lowest free file descriptor of the current process,
+ * doubling its descriptor table if every slot is taken.  Returns -1
+ * if the process already has MAX_FDS descriptors or memory is short.
+ */
+static int alloc_fd(void)
+{
+	struct thread *cur = thread_current();
 
-	struct list_elem *e;
+	for (int fd = cur->fd_first_free; fd < cur->fd_cnt; fd++)
+		if (cur->fds[fd] == NULL)
+			return fd;
 
-	for (e = list_begin(&cur->file_descriptors);
-		 e != list_end(&cur->file_descriptors);
-		 e = list_next(e))
-	{
-		struct file_descriptor *fd_entry = list_entry(e, struct file_descriptor, elem);
-		if (fd_entry->fd == fd)
-			return fd_entry->file;
-	}
-	return NULL;
+	if (cur->fd_cnt >= MAX_FDS)
+		return -1;
+
+	int new_cnt = cur->fd_cnt > 0 ? cur->fd_cnt * 2 : FD_TABLE_INIT;
+	if (new_cnt > MAX_FDS)
+		new_cnt = MAX_FDS;
+	struct file **fds = realloc(cur->fds, new_cnt * sizeof *fds);
+	if (fds == NULL)
+		return -1;
+	memset(fds + cur->fd_cnt, 0, (new_cnt - cur->fd_cnt) * sizeof *fds);
+
+	int fd = cur->fd_cnt > 2 ? cur->fd_cnt : 2;
+	cur->fds = fds;
+	cur->fd_cnt = new_cnt;
+	return fd;
 }
+
 // Have to be able to open the same file and assign a new file descriptor
 int open(const char *file_name)
 {
+	char name[NAME_MAX + 1];
 
-	validate_string(file_name);
+	if (strncpy_from_user(name, file_name, sizeof name) < 0)
+		return -1;
 	struct thread *cur = thread_current();
-	if (cur->next_fd >= MAX_FDS)
+	int fd = alloc_fd();
+	if (fd < 0)
 		return -1;
 
-	struct file *f = filesys_open(file_name);
+	struct file *f = filesys_open(name);
 	if (f == NULL)
 		return -1;
 
-	struct file_descriptor *fd_entry = malloc(sizeof(struct file_descriptor));
-	fd_entry->fd = cur->next_fd;
-	cur->next_fd++;
-	fd_entry->file = f;
-
-	list_push_back(&cur->file_descriptors, &fd_entry->elem);
-
-	return fd_entry->fd;
+	cur->fds[fd] = f;
+	cur->fd_first_free = fd + 1;
+	return fd;
 }
 
 void close(int fd)
 {
-	struct thread *this_thread = thread_current();
-	if (fd < 2 || fd >= MAX_FDS)
+	struct thread *cur = thread_current();
+	struct file *f = get_file(fd);
+	if (f == NULL)
 		return;
 
-	struct list_elem *e;
-
-	for (e = list_begin(&this_thread->file_descriptors);
-		 e != list_end(&this_thread->file_descriptors);
-		 e = list_next(e))
-	{
-		struct file_descriptor *fd_entry = list_entry(e, struct file_descriptor, elem);
-		if (fd_entry->fd == fd)
-		{
-			file_close(fd_entry->file);
-			list_remove(e);
-			free(fd_entry);
-			return;
-		}
-	}
+	file_close(f);
+	cur->fds[fd] = NULL;
+	if (fd < cur->fd_first_free)
+		cur->fd_first_free = fd;
 }
 
 int write(int fd, const void *buffer, unsigned size)
 {
-	validate_buffer(buffer, size);
 	if (fd == 1)
 	{
 		putbuf(buffer, size);
@@ -246,13 +376,11 @@ int write(int fd, const void *buffer, unsigned size)
 
 int read(int fd, void *buffer, unsigned size)
 {
-	validate_buffer(buffer, size);
-
 	if (fd == 0)
 	{
 		for (unsigned i = 0; i < size; i++)
 		{
-			*(int *)(buffer + i) = input_getc();
+			((char *)buffer)[i] = input_getc();
 			// Echo it back :D
 			putbuf(buffer + i, 1);
 		}
@@ -266,17 +394,125 @@ int read(int fd, void *buffer, unsigned size)
 	return file_read(f, buffer, size);
 }
 
-bool remove(const char *file)
+/**
+ * Reads SIZE bytes from file FD at byte OFFSET into BUFFER without
+ * using or moving the file position.  Returns the number of bytes
+ * read, or -1 if FD is not an open file or OFFSET is too large.
+ */
+int pread(int fd, void *buffer, unsigned size, unsigned offset)
 {
+	struct file *f = get_file(fd);
 
-	return filesys_remove(file);
+	if (f == NULL || (off_t)offset < 0)
+		return -1;
+
+	return file_read_at(f, buffer, size, offset);
 }
 
-int filesize(int fd)
+/**
+ * Writes SIZE bytes from BUFFER to file FD at byte OFFSET without
+ * using or moving the file position.  Returns the number of bytes
+ * written, or -1 if FD is not an open file or OFFSET is too
+ * large.
+ */
+int pwrite(int fd, const void *buffer, unsigned size, unsigned offset)
+{
+	struct file *f = get_file(fd);
+
+	if (f == NULL || (off_t)offset < 0)
+		return -1;
+
+	return file_write_at(f, buffer, size, offset);
+}
+
+/**
+ * Copies the IOVCNT-entry iovec array at user address UIOV into
+ * KIOV and checks every segment it describes, killing the process
+ * if one is not mapped.  Returns the segments' total length, or -1
+ * if IOVCNT is out of range or the total does not fit in an int.
+ */
+static int fetch_iovec(struct iovec *kiov, const struct iovec *uiov, int iovcnt)
+{
+	size_t total = 0;
+
+	if (iovcnt < 0 || iovcnt > IOV_MAX)
+		return -1;
+	copy_from_user(kiov, uiov, iovcnt * sizeof *kiov);
+	for (int i = 0; i < iovcnt; i++)
+	{
+		if (kiov[i].iov_len > INT_MAX - total)
+			return -1;
+		total += kiov[i].iov_len;
+		validate_buffer(kiov[i].iov_base, kiov[i].iov_len);
+	}
+	return total;
+}
+
+/**
+ * Reads from file FD into the IOVCNT buffers described by IOV,
+ * filling each in turn, as one file system operation.  Returns
+ * the number of bytes read, or -1 on error.
+ */
+int readv(int fd, const struct iovec *iov, int iovcnt)
 {
-	if (fd < 2 || fd >= MAX_FDS)
+	struct iovec kiov[IOV_MAX];
+
+	if (fetch_iovec(kiov, iov, iovcnt) < 0)
 		return -1;
 
+	if (fd == 0)
+	{
+		int bytes_read = 0;
+		for (int i = 0; i < iovcnt; i++)
+			bytes_read += read(fd, kiov[i].iov_base, kiov[i].iov_len);
+		return bytes_read;
+	}
+	struct file *f = get_file(fd);
+
+	if (f == NULL)
+		return -1;
+
+	return file_readv(f, kiov, iovcnt);
+}
+
+/**
+ * Writes the IOVCNT buffers described by IOV to file FD, one after
+ * another, as one file system operation.  Console output is
+ * written without other output coming between the buffers.
+ * Returns the number of bytes written, or -1 on error.
+ */
+int writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	struct iovec kiov[IOV_MAX];
+	int total = fetch_iovec(kiov, iov, iovcnt);
+
+	if (total < 0)
+		return -1;
+
+	if (fd == 1)
+	{
+		putbufv(kiov, iovcnt);
+		return total;
+	}
+	struct file *f = get_file(fd);
+
+	if (f == NULL)
+		return -1;
+
+	return file_writev(f, kiov, iovcnt);
+}
+
+bool remove(const char *file)
+{
+	char name[NAME_MAX + 1];
+
+	if (strncpy_from_user(name, file, sizeof name) < 0)
+		return false;
+	return filesys_remove(name);
+}
+
+int filesize(int fd)
+{
 	struct file *f = get_file(fd);
 
 	if (f == NULL)
@@ -288,15 +524,13 @@ int filesize(int fd)
 void seek(int fd, unsigned position)
 {
 	struct file *f = get_file(fd);
-	// File_seek already does this...
 
-	// TODO: SHOULD IT FAIL SILENTLY?
-	// if (f == NULL)
-	// 	return;
-
-	ASSERT(f != NULL);
+	if (f == NULL)
+		return;
 
-	if (position > file_length(f))
+	/* Seeking past end of file is fine: a later write grows the
+		file to match. */
+	if ((off_t)position < 0)
 		return;
 	file_seek(f, position);
 }
@@ -316,66 +550,128 @@ void sleep(int millis)
 	timer_msleep(millis);
 }
 
-void retrive_args1(void *esp, int *argv[], unsigned argc)
+/* Copies the I/O statistics of the block device numbered IDX, in
+	kernel probe order, into STATS.  Returns false if there is no
+	such device. */
+bool blockstats(unsigned idx, struct block_stats *stats)
 {
+	struct block *block;
+	struct block_stats kstats;
+
+	for (block = block_first(); block != NULL && idx > 0; block = block_next(block))
+		idx--;
+	if (block == NULL)
+		return false;
+	block_get_stats(block, &kstats);
+	copy_to_user(stats, &kstats, sizeof kstats);
+	return true;
+}
 
-	/**
-	 * arg3
-	 * arg2
-	 * arg1
-	 * Number for syscall  <- esp
-	 * Theroetically speaking we could just instantly take argc
-	 */
-
-	// Validate all bytes of the arguments on the stack.
-	validate_set_args(esp + 4, argc);
-	int *arg_ptr = (int *)esp;
-	for (unsigned i = 0; i < argc; i++)
-	{
-		// Validate each pointer to the argument.
-		validate_pointer((void *)(arg_ptr));
-		arg_ptr += 1;
-		argv[i] = *arg_ptr;
-	}
+/**
+ * Returns true if the SIZE bytes starting at UADDR all lie in
+ * mapped user pages.  Looks up each page once, however large the
+ * range.
+ */
+bool user_range_ok(const void *uaddr, size_t size)
+{
+	uint32_t *pd = thread_current()->pagedir;
+	const uint8_t *start = uaddr;
+	const uint8_t *end = start + size - 1;
+	const uint8_t *page;
+
+	if (size == 0)
+		return true;
+	if (end < start || !is_user_vaddr(end))
+		return false;
+	for (page = pg_round_down(start); page <= end; page += PGSIZE)
+		if (pagedir_get_page(pd, page) == NULL)
+			return false;
+	return true;
 }
 
-void validate_pointer(void *ptr)
+/**
+ * Copies SIZE bytes from user address USRC to kernel buffer DST.
+ * Kills the process if any of the source bytes is not mapped.
+ */
+void copy_from_user(void *dst, const void *usrc, size_t size)
 {
-	if (ptr == NULL)
-	{
+	if (!user_range_ok(usrc, size))
 		exit(-1);
-	}
-	if (is_kernel_vaddr(ptr))
-	{
-		exit(-1);
-	}
-	if (pagedir_get_page(thread_current()->pagedir, ptr) == NULL)
-	{
+	memcpy(dst, usrc, size);
+}
+
+/**
+ * Copies SIZE bytes from kernel buffer SRC to user address UDST.
+ * Kills the process if any of the destination bytes is not
+ * mapped.
+ */
+void copy_to_user(void *udst, const void *src, size_t size)
+{
+	if (!user_range_ok(udst, size))
 		exit(-1);
-	}
+	memcpy(udst, src, size);
 }
 
-void validate_buffer(void *buffer, unsigned size)
+/**
+ * Returns the length of the user string USTR, or MAXLEN if it has
+ * no null terminator among its first MAXLEN bytes.  Checks each
+ * page once and scans it with strnlen(), killing the process if
+ * the string runs into an unmapped page.
+ */
+static size_t user_strnlen(const char *ustr, size_t maxlen)
 {
-	// if we valdiate the start and end of the buffer the entire buff should be safe.
-	const char *buf = (const char *)buffer;
-	// validate_pointer(buf);
-	// validate_pointer(buf + size);
-	for (unsigned i = 0; i < size; i++)
+	uint32_t *pd = thread_current()->pagedir;
+	size_t len = 0;
+
+	while (len < maxlen)
 	{
-		validate_pointer((void *)(buf + i));
+		const char *p = ustr + len;
+		size_t chunk = (const char *)pg_round_down(p) + PGSIZE - p;
+		size_t n;
+
+		if (!is_user_vaddr(p) || pagedir_get_page(pd, p) == NULL)
+			exit(-1);
+		if (chunk > maxlen - len)
+			chunk = maxlen - len;
+		n = strnlen(p, chunk);
+		len += n;
+		if (n < chunk)
+			break;
 	}
+	return len;
 }
 
-void validate_string(const char *str)
+/**
+ * Copies the user string USRC, including its null terminator, into
+ * the SIZE-byte kernel buffer DST.  Returns the string's length, or
+ * -1 if it does not fit.  Kills the process if the string runs
+ * into an unmapped page.
+ */
+int strncpy_from_user(char *dst, const char *usrc, size_t size)
+{
+	size_t len = user_strnlen(usrc, size);
+
+	if (len >= size)
+		return -1;
+	memcpy(dst, usrc, len + 1);
+	return len;
+}
+
+/**
+ * Kills the process unless the SIZE bytes at BUFFER are mapped
+ * user memory.
+ */
+void validate_buffer(const void *buffer, unsigned size)
 {
-	if (str == NULL)
+	if (!user_range_ok(buffer, size))
 		exit(-1);
-	// Validate first pointer and then every subsequent byte until the terminator.
-	validate_pointer(str);
-	while (*str != '\0')
-	{
-		str++;
-		validate_pointer(str);
-	}
-}
\ No newline at end of file
+}
+
+/**
+ * Kills the process unless STR is a null-terminated string in
+ * mapped user memory.
+ */
+void validate_string(const char *str)
+{
+	user_strnlen(str, SIZE_MAX);
+}